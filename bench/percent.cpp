@@ -0,0 +1,160 @@
+/* playlist percent encoding benchmark
+ * Copyright (C) 2021 - 2023 James D. Smith
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <https://www.gnu.org/licenses/>.
+ */
+
+#include "playlist.h"
+
+#include <chrono>
+#include <iostream>
+#include <random>
+#include <regex>
+#include <string>
+#include <vector>
+
+#include <unistd.h>
+
+// The regex implementations these replaced, for comparison.
+const std::string regexEncode(const std::string &uri) {
+  std::ostringstream uriOut;
+  std::regex r("[!:\\/\\-._~0-9A-Za-z]");
+
+  for (const char &c : uri) {
+    if (std::regex_match(std::string({c}), r)) {
+      uriOut << c;
+    } else {
+      uriOut << "%" << std::uppercase << std::hex << (0xff & c);
+    }
+  }
+
+  return uriOut.str();
+}
+
+const std::string regexDecode(std::string uri) {
+  int len = uri.size() - 2;
+
+  for (int i = 0; i < len; i++) {
+    std::smatch match;
+    std::string buf = uri.substr(i, 3);
+
+    if (std::regex_match(buf, match, std::regex("%[0-9A-F]{2}"))) {
+      std::string c;
+
+      buf = buf.replace(0, 1, "0x");
+      c = (char)std::stoi(buf, nullptr, 16);
+      uri = uri.replace(uri.begin() + i, uri.begin() + i + 3, c);
+    }
+
+    len = uri.size() - 2;
+  }
+
+  return uri;
+}
+
+void help() {
+  std::cout << "Usage: percent-bench [-n targets] [-l length] [-r rounds]"
+            << std::endl;
+}
+
+template <typename Function>
+double measure(const std::vector<std::string> &targets, int rounds,
+               Function function, std::size_t &bytes) {
+  const auto start = std::chrono::steady_clock::now();
+
+  bytes = 0;
+
+  for (int r = 0; r < rounds; r++)
+    for (const std::string &target : targets)
+      bytes += function(target).size();
+
+  return std::chrono::duration<double>(std::chrono::steady_clock::now() -
+                                       start)
+      .count();
+}
+
+int main(int argc, char **argv) {
+  const std::string words[] = {"Music",  "Artist", "Album", "01 Track",
+                               "Live at", "Café",  "Ünïcödé", "(Remix)",
+                               "A&B",    "50%",   "100%25", "x%2Fy"};
+  std::vector<std::string> targets, encoded;
+  std::mt19937 random(1);
+  std::size_t bytes;
+  int c, count(1000), length(80), rounds(3);
+
+  while ((c = getopt(argc, argv, "n:l:r:h")) != -1) {
+    switch (c) {
+    case 'n':
+      count = std::stoi(optarg);
+
+      break;
+    case 'l':
+      length = std::stoi(optarg);
+
+      break;
+    case 'r':
+      rounds = std::stoi(optarg);
+
+      break;
+    default:
+      help();
+
+      return (c == 'h') ? 0 : 2;
+    }
+  }
+
+  for (int i = 0; i < count; i++) {
+    std::string target;
+
+    while (target.size() < length)
+      target += "/" + words[random() % std::size(words)];
+
+    targets.push_back(target + ".mp3");
+    encoded.push_back(percentEncode(targets.back()));
+  }
+
+  for (std::size_t i = 0; i < targets.size(); i++) {
+    if ((regexEncode(targets[i]) != encoded[i]) ||
+        (regexDecode(encoded[i]) != percentDecode(encoded[i]))) {
+      std::cerr << "Mismatch: " << targets[i] << std::endl;
+
+      return 1;
+    }
+  }
+
+  const auto report = [&](const char *name,
+                          const std::vector<std::string> &input,
+                          const auto &function) {
+    const double time = measure(input, rounds, function, bytes);
+
+    std::cout << name << ": " << time << " s\t"
+              << (time * 1e9 / (input.size() * rounds)) << " ns/target"
+              << std::endl;
+
+    return time;
+  };
+
+  std::cout << "Targets: " << count << " x ~" << length << " bytes, " << rounds
+            << " rounds" << std::endl;
+
+  const double encodeRegex = report("Encode (regex)", targets, regexEncode);
+  const double encodeTable = report("Encode (table)", targets, percentEncode);
+  const double decodeRegex = report("Decode (regex)", encoded, regexDecode);
+  const double decodeTable = report("Decode (table)", encoded, percentDecode);
+
+  std::cout << "Speedup: encode " << (encodeRegex / encodeTable) << "x\tdecode "
+            << (decodeRegex / decodeTable) << "x" << std::endl;
+
+  return 0;
+}
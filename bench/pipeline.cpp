@@ -0,0 +1,193 @@
+/* playlist entry pipeline benchmark
+ * Copyright (C) 2021 - 2023 James D. Smith
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <https://www.gnu.org/licenses/>.
+ */
+
+#include "playlist.h"
+
+#include <atomic>
+#include <chrono>
+#include <functional>
+#include <cstdlib>
+#include <iostream>
+#include <new>
+#include <string>
+#include <vector>
+
+#include <unistd.h>
+
+static std::atomic<std::size_t> allocations{0};
+
+void *operator new(std::size_t size) {
+  allocations++;
+
+  if (void *p = std::malloc(size ? size : 1))
+    return p;
+
+  throw std::bad_alloc();
+}
+
+void operator delete(void *p) noexcept { std::free(p); }
+void operator delete(void *p, std::size_t) noexcept { std::free(p); }
+
+void help() {
+  std::cout << "Usage: pipeline-bench [-n entries] [-p playlists] [-m moves]"
+            << std::endl;
+}
+
+// The copying stages the shipped helpers replaced, for comparison.
+void copySplice(Entries &entries, Entries &from) {
+  entries.insert(entries.end(), from.begin(), from.end());
+}
+
+void copyMove(Entries &entries, std::size_t from, std::size_t to) {
+  Entry entry = entries.at(from);
+
+  entries.erase(entries.begin() + from);
+  entries.emplace(entries.begin() + to, entry);
+}
+
+void copyCompact(Entries &entries, const std::function<bool(Entry &)> &keep) {
+  for (Entries::iterator it = entries.begin(); it != entries.end();) {
+    if (!keep(*it)) {
+      it = entries.erase(it);
+
+      continue;
+    }
+
+    it++;
+  }
+}
+
+int main(int argc, char **argv) {
+  std::vector<fs::path> pls;
+  int c, count(20000), moves(100), parts(4);
+
+  while ((c = getopt(argc, argv, "n:p:m:h")) != -1) {
+    switch (c) {
+    case 'n':
+      count = std::stoi(optarg);
+
+      break;
+    case 'p':
+      parts = std::stoi(optarg);
+
+      break;
+    case 'm':
+      moves = std::stoi(optarg);
+
+      break;
+    default:
+      help();
+
+      return (c == 'h') ? 0 : 2;
+    }
+  }
+
+  for (int p = 0; p < parts; p++) {
+    pls.push_back(fs::temp_directory_path() /
+                  ("playlist-pipeline-bench-" + std::to_string(p) + ".m3u"));
+
+    std::ofstream file(pls.back());
+
+    file << "#EXTM3U" << std::endl;
+
+    for (int i = p; i < count; i += parts)
+      file << "#EXTINF:" << (180 + i % 120) << " artist=\"Artist " << (i % 50)
+           << "\" album=\"Album " << (i % 200) << "\",Title of track " << i
+           << std::endl
+           << "/music/library/artist " << (i % 50) << "/album " << (i % 200)
+           << "/" << i << ".mp3" << std::endl;
+  }
+
+  const auto stage = [](const char *name, const auto &function,
+                        std::size_t entries) {
+    const std::size_t before = allocations;
+    const auto start = std::chrono::steady_clock::now();
+
+    function();
+
+    const std::chrono::duration<double> time =
+        std::chrono::steady_clock::now() - start;
+    const std::size_t allocs = allocations - before;
+
+    std::cout << name << ": " << time.count() << " s\t" << allocs
+              << " allocations\t" << (double(allocs) / entries)
+              << " per entry" << std::endl;
+  };
+
+  std::cout << "Entries: " << count << " in " << parts << " playlists, "
+            << moves << " moves" << std::endl;
+
+  for (const bool copy : {true, false}) {
+    std::vector<Entries> parsed(parts);
+    Entries entries;
+
+    std::cout << (copy ? "Copying pipeline" : "Moving pipeline") << std::endl;
+
+    stage(
+        "  Parse",
+        [&] {
+          for (int p = 0; p < parts; p++)
+            playlist(pls[p])->parse(parsed[p]);
+        },
+        count);
+
+    for (Entries &part : parsed)
+      for (Entry &entry : part)
+        entry.track = std::stoi(entry.target.stem().string());
+
+    stage(
+        "  Splice",
+        [&] {
+          std::size_t size = 0;
+
+          for (const Entries &part : parsed)
+            size += part.size();
+
+          entries.reserve(size);
+
+          for (Entries &part : parsed)
+            copy ? copySplice(entries, part) : spliceEntries(entries, part);
+        },
+        count);
+
+    stage(
+        "  Reorder",
+        [&] {
+          for (int m = 0; m < moves; m++) {
+            const std::size_t from = (m * 7919ULL) % entries.size(),
+                              to = (m * 104729ULL) % entries.size();
+
+            copy ? copyMove(entries, from, to) : moveEntry(entries, from, to);
+          }
+        },
+        count);
+
+    stage(
+        "  Compact",
+        [&] {
+          const auto keep = [](Entry &entry) { return entry.track % 10 != 0; };
+
+          copy ? copyCompact(entries, keep) : compactEntries(entries, keep);
+        },
+        count);
+  }
+
+  for (const fs::path &pl : pls)
+    fs::remove(pl);
+
+  return 0;
+}
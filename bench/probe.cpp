@@ -0,0 +1,123 @@
+/* playlist duration probe benchmark
+ * Copyright (C) 2021 - 2023 James D. Smith
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <https://www.gnu.org/licenses/>.
+ */
+
+#include "probe.h"
+
+#include <chrono>
+#include <cstdlib>
+#include <iostream>
+#include <string>
+#include <vector>
+
+#include <taglib/fileref.h>
+#include <unistd.h>
+
+void help() {
+  std::cout << "Usage: probe-bench [-r rounds] [-t tolerance ms] "
+               "target|directory..."
+            << std::endl;
+}
+
+int main(int argc, char **argv) {
+  std::vector<fs::path> targets;
+  std::vector<int> probed, tagged;
+  std::chrono::duration<double> probeTime{}, tagTime{};
+  int c, mismatched(0), rounds(3), tolerance(50), unprobed(0);
+
+  while ((c = getopt(argc, argv, "r:t:h")) != -1) {
+    switch (c) {
+    case 'r':
+      rounds = std::max(1, std::atoi(optarg));
+
+      break;
+    case 't':
+      tolerance = std::atoi(optarg);
+
+      break;
+    default:
+      help();
+
+      return (c == 'h') ? 0 : 2;
+    }
+  }
+
+  for (; optind < argc; optind++) {
+    const fs::path target(argv[optind]);
+
+    if (fs::is_directory(target)) {
+      for (const auto &file : fs::recursive_directory_iterator(target))
+        if (file.is_regular_file())
+          targets.push_back(file.path());
+    } else {
+      targets.push_back(target);
+    }
+  }
+
+  if (targets.empty()) {
+    help();
+
+    return 2;
+  }
+
+  probed.resize(targets.size());
+  tagged.resize(targets.size());
+
+  for (int r = 0; r < rounds; r++) {
+    auto start = std::chrono::steady_clock::now();
+
+    for (std::size_t i = 0; i < targets.size(); i++)
+      probed[i] = Probe(targets[i]).duration();
+
+    probeTime += std::chrono::steady_clock::now() - start;
+    start = std::chrono::steady_clock::now();
+
+    for (std::size_t i = 0; i < targets.size(); i++) {
+      TagLib::FileRef file(targets[i].c_str());
+
+      tagged[i] = (!file.isNull() && file.audioProperties())
+                      ? file.audioProperties()->lengthInMilliseconds()
+                      : -1;
+    }
+
+    tagTime += std::chrono::steady_clock::now() - start;
+  }
+
+  for (std::size_t i = 0; i < targets.size(); i++) {
+    if (probed[i] < 0) {
+      unprobed++;
+    } else if ((tagged[i] >= 0) &&
+               (std::abs(probed[i] - tagged[i]) > tolerance)) {
+      mismatched++;
+      std::cout << "Mismatch: " << targets[i] << " probe " << probed[i]
+                << " ms, taglib " << tagged[i] << " ms" << std::endl;
+    }
+  }
+
+  std::cout << "Targets: " << targets.size() << " x " << rounds << " rounds"
+            << std::endl;
+  std::cout << "Probed: " << (targets.size() - unprobed)
+            << "\tUnrecognised: " << unprobed
+            << "\tMismatched: " << mismatched << std::endl;
+  std::cout << "Probe time: " << probeTime.count() << " s ("
+            << (probeTime.count() * 1e6 / (targets.size() * rounds))
+            << " us/target)" << std::endl;
+  std::cout << "TagLib time: " << tagTime.count() << " s ("
+            << (tagTime.count() * 1e6 / (targets.size() * rounds))
+            << " us/target)" << std::endl;
+
+  return 0;
+}
@@ -0,0 +1,258 @@
+/* playlist network verification benchmark
+ * Copyright (C) 2021 - 2023 James D. Smith
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <https://www.gnu.org/licenses/>.
+ */
+
+#include "playlist.h"
+
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <iostream>
+#include <mutex>
+#include <random>
+#include <string>
+#include <thread>
+#include <unordered_map>
+#include <vector>
+
+#include <arpa/inet.h>
+#include <netinet/in.h>
+#include <sys/socket.h>
+#include <unistd.h>
+
+struct Server {
+  int latency = 20;
+  int slowLatency = 500;
+  std::vector<int> ports;
+  std::atomic<int> requests{0};
+  int slowHosts = 1;
+  // Time of the last response for each path, as seen by the batch client.
+  std::unordered_map<std::string, std::chrono::steady_clock::time_point>
+      answered;
+  std::mutex mutex;
+};
+
+void help() {
+  std::cout << "Usage: verify-bench [-n entries] [-H hosts] [-S slow hosts] "
+               "[-l latency ms] [-L slow latency ms] [-f fail %] "
+               "[-e head unsupported %] [-c connections]"
+            << std::endl;
+}
+
+void serve(Server &server, int socket, bool slow) {
+  std::string buffer;
+  char data[4096];
+  ssize_t size;
+
+  while ((size = recv(socket, data, sizeof(data), 0)) > 0) {
+    std::size_t end;
+
+    buffer.append(data, size);
+
+    while ((end = buffer.find("\r\n\r\n")) != std::string::npos) {
+      const std::string request = buffer.substr(0, end);
+      const std::size_t path = request.find(' ') + 1;
+      const bool head = (request.rfind("HEAD ", 0) == 0);
+      std::string status = "200 OK";
+
+      buffer.erase(0, end + 4);
+      server.requests++;
+
+      std::this_thread::sleep_for(std::chrono::milliseconds(
+          slow ? server.slowLatency : server.latency));
+
+      if (request.find(" /fail/") != std::string::npos) {
+        status = "503 Service Unavailable";
+      } else if (head && (request.find(" /nohead/") != std::string::npos)) {
+        status = "405 Method Not Allowed";
+      }
+
+      const std::string response = "HTTP/1.1 " + status +
+                                   "\r\nContent-Length: 0\r\n"
+                                   "Connection: keep-alive\r\n\r\n";
+
+      if (send(socket, response.c_str(), response.size(), MSG_NOSIGNAL) < 0)
+        break;
+
+      std::lock_guard<std::mutex> lock(server.mutex);
+
+      server.answered[request.substr(path, request.find(' ', path) - path)] =
+          std::chrono::steady_clock::now();
+    }
+  }
+
+  close(socket);
+}
+
+void serveHosts(Server &server, int hosts) {
+  for (int h = 0; h < hosts; h++) {
+    sockaddr_in addr{};
+    socklen_t len = sizeof(addr);
+    int s = socket(AF_INET, SOCK_STREAM, 0), on = 1;
+
+    setsockopt(s, SOL_SOCKET, SO_REUSEADDR, &on, sizeof(on));
+    addr.sin_family = AF_INET;
+    addr.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+
+    if (bind(s, (sockaddr *)&addr, sizeof(addr)) || listen(s, 512)) {
+      std::cerr << "Could not listen on loopback" << std::endl;
+
+      std::exit(2);
+    }
+
+    getsockname(s, (sockaddr *)&addr, &len);
+    server.ports.push_back(ntohs(addr.sin_port));
+
+    std::thread([&server, s, slow = (h < server.slowHosts)]() {
+      int c;
+
+      while ((c = accept(s, nullptr, nullptr)) >= 0)
+        std::thread(serve, std::ref(server), c, slow).detach();
+    }).detach();
+  }
+}
+
+int main(int argc, char **argv) {
+  Server server;
+  Entries entries;
+  Targets targets;
+  std::mt19937 random(1);
+  std::vector<double> latencies;
+  int c, entryCount(2000), failRate(5), hosts(8), noHeadRate(5), valid(0);
+
+  while ((c = getopt(argc, argv, "n:H:S:l:L:f:e:c:h")) != -1) {
+    switch (c) {
+    case 'n':
+      entryCount = std::stoi(optarg);
+
+      break;
+    case 'H':
+      hosts = std::stoi(optarg);
+
+      break;
+    case 'S':
+      server.slowHosts = std::stoi(optarg);
+
+      break;
+    case 'l':
+      server.latency = std::stoi(optarg);
+
+      break;
+    case 'L':
+      server.slowLatency = std::stoi(optarg);
+
+      break;
+    case 'f':
+      failRate = std::stoi(optarg);
+
+      break;
+    case 'e':
+      noHeadRate = std::stoi(optarg);
+
+      break;
+    case 'c':
+      connections = std::stoi(optarg);
+
+      break;
+    default:
+      help();
+
+      return (c == 'h') ? 0 : 2;
+    }
+  }
+
+  if (hosts < 1) {
+    std::cerr << "Hosts (-H) must be at least 1" << std::endl;
+
+    return 2;
+  }
+
+  serveHosts(server, hosts);
+
+  const fs::path pl = fs::temp_directory_path() / "playlist-verify-bench.m3u";
+  std::ofstream file(pl);
+
+  for (int i = 0; i < entryCount; i++) {
+    const int roll = random() % 100;
+    std::string kind = "ok";
+
+    if (roll < failRate) {
+      kind = "fail";
+    } else if (roll < (failRate + noHeadRate)) {
+      kind = "nohead";
+    }
+
+    file << "http://127.0.0.1:" << server.ports[random() % hosts] << "/"
+         << kind << "/" << i << ".mp3" << std::endl;
+  }
+
+  file.close();
+
+  playlist(pl)->parse(entries);
+  fs::remove(pl);
+
+  flags[26] = true;
+
+  for (Entry &entry : entries)
+    targets.emplace_back(entry.target, &entry.validTarget);
+
+  const auto start = std::chrono::steady_clock::now();
+
+  validTargets(targets);
+
+  const std::chrono::duration<double> total =
+      std::chrono::steady_clock::now() - start;
+
+  // Each target completes with its last response in the batch. Targets
+  // skipped for an unresponsive host complete with the batch.
+  std::lock_guard<std::mutex> lock(server.mutex);
+
+  for (const Entry &entry : entries) {
+    const std::string target = entry.target.string();
+    const auto it =
+        server.answered.find(target.substr(target.find('/', 7)));
+
+    valid += entry.validTarget;
+    latencies.push_back(
+        (it == server.answered.end())
+            ? total.count() * 1000
+            : std::chrono::duration<double, std::milli>(it->second - start)
+                  .count());
+  }
+
+  std::sort(latencies.begin(), latencies.end());
+
+  const auto percentile = [&](double p) {
+    return latencies.empty()
+               ? 0
+               : latencies.at(std::min<std::size_t>(latencies.size() - 1,
+                                                    latencies.size() * p));
+  };
+
+  std::cout << "Entries: " << entries.size() << " on " << hosts << " hosts ("
+            << server.slowHosts << " slow)" << std::endl;
+  std::cout << "Requests served: " << server.requests << std::endl;
+  std::cout << "Valid: " << valid << "\tUnfound: " << (entries.size() - valid)
+            << std::endl;
+  std::cout << "Batch time: " << total.count() << " s" << std::endl;
+  std::cout << "Throughput: " << (entries.size() / total.count())
+            << " targets/s" << std::endl;
+  std::cout << "Target completion (ms): p50 " << percentile(0.5)
+            << "\tp90 " << percentile(0.9) << "\tp99 " << percentile(0.99)
+            << "\tmax " << percentile(1) << std::endl;
+
+  return 0;
+}
@@ -17,6 +17,8 @@
 
 #include "asx.h"
 
+#include <bitset>
+#include <cstring>
 #include <iterator>
 
 #include <pugixml.hpp>
@@ -26,57 +28,88 @@
 using namespace pugi;
 
 void ASX::parse(Entries &entries) {
+  MappedFile file(m_playlist);
   pugi::xml_document playlist;
-  std::ifstream file(m_playlist);
-  pugi::xml_parse_result result(playlist.load(file));
-  pugi::xml_node plEntry;
+  pugi::xml_parse_result result(
+      playlist.load_buffer_inplace(file.data(), file.size()));
   std::string comment, creator, image, title;
 
-  file.close();
-
   if (result && !file.bad() && playlist.child(ASX_ROOT)) {
-    comment = playlist.child(ASX_ROOT).child("ABSTRACT").text().as_string();
-    creator = playlist.child(ASX_ROOT).child("AUTHOR").text().as_string();
-    title = playlist.child(ASX_ROOT).child("TITLE").text().as_string();
-
-    for (const pugi::xml_node &param :
-         playlist.child(ASX_ROOT).children("PARAM")) {
-      if (param.attribute("NAME").as_string() == std::string("image"))
-        image = param.attribute("VALUE").as_string();
+    const pugi::xml_node root = playlist.child(ASX_ROOT);
+    std::bitset<3> seen;
+
+    // Playlist fields: the first of each element, the last image PARAM.
+    for (pugi::xml_node node = root.first_child(); node;
+         node = node.next_sibling()) {
+      const char *name = node.name();
+
+      if (!seen[0] && !std::strcmp(name, "ABSTRACT")) {
+        comment = node.text().as_string();
+        seen[0] = true;
+      } else if (!seen[1] && !std::strcmp(name, "AUTHOR")) {
+        creator = node.text().as_string();
+        seen[1] = true;
+      } else if (!seen[2] && !std::strcmp(name, "TITLE")) {
+        title = node.text().as_string();
+        seen[2] = true;
+      } else if (!std::strcmp(name, "PARAM") &&
+                 !std::strcmp(node.attribute("NAME").as_string(), "image")) {
+        image = node.attribute("VALUE").as_string();
+      }
     }
 
+    const std::shared_ptr<const Header> header = std::make_shared<Header>(
+        Header{image, m_playlist, creator, comment, title});
+
+    const auto plEntries = root.children("ENTRY");
     int t = 1;
-    for (const pugi::xml_node &plEntry :
-         playlist.child(ASX_ROOT).children("ENTRY")) {
-      Entry entry;
-
-      entry.artist = plEntry.child("AUTHOR").text().as_string();
-      entry.comment = plEntry.child("ABSTRACT").text().as_string();
-      entry.info = plEntry.child("MOREINFO").attribute("href").as_string();
-      entry.target = plEntry.child("REF").attribute("href").as_string();
-      entry.title = plEntry.child("TITLE").text().as_string();
-      entry.track = t;
 
-      for (const pugi::xml_node &param : plEntry.children("PARAM")) {
-        if (param.attribute("NAME").as_string() == std::string("album"))
-          entry.album = param.attribute("VALUE").as_string();
-        if (param.attribute("NAME").as_string() == std::string("duration"))
-          entry.duration = param.attribute("VALUE").as_int();
-        if (param.attribute("NAME").as_string() == std::string("identifier"))
-          entry.identifier = param.attribute("VALUE").as_string();
-        if (param.attribute("NAME").as_string() == std::string("image"))
-          entry.image = param.attribute("VALUE").as_string();
-        if (param.attribute("NAME").as_string() == std::string("track"))
-          entry.albumTrack = param.attribute("VALUE").as_int();
+    entries.reserve(entries.size() +
+                    std::distance(plEntries.begin(), plEntries.end()));
+
+    for (pugi::xml_node plEntry = root.child("ENTRY"); plEntry;
+         plEntry = plEntry.next_sibling("ENTRY")) {
+      Entry &entry = entries.emplace_back();
+      std::bitset<5> seen;
+
+      // Entry elements: the first of each name; PARAMs: the last of each.
+      for (pugi::xml_node node = plEntry.first_child(); node;
+           node = node.next_sibling()) {
+        const char *name = node.name();
+
+        if (!std::strcmp(name, "PARAM")) {
+          const char *param = node.attribute("NAME").as_string();
+
+          if (!std::strcmp(param, "album"))
+            entry.album = node.attribute("VALUE").as_string();
+          if (!std::strcmp(param, "duration"))
+            entry.duration = node.attribute("VALUE").as_int();
+          if (!std::strcmp(param, "identifier"))
+            entry.identifier = node.attribute("VALUE").as_string();
+          if (!std::strcmp(param, "image"))
+            entry.image = node.attribute("VALUE").as_string();
+          if (!std::strcmp(param, "track"))
+            entry.albumTrack = node.attribute("VALUE").as_int();
+        } else if (!seen[0] && !std::strcmp(name, "AUTHOR")) {
+          entry.artist = node.text().as_string();
+          seen[0] = true;
+        } else if (!seen[1] && !std::strcmp(name, "ABSTRACT")) {
+          entry.comment = node.text().as_string();
+          seen[1] = true;
+        } else if (!seen[2] && !std::strcmp(name, "MOREINFO")) {
+          entry.info = node.attribute("href").as_string();
+          seen[2] = true;
+        } else if (!seen[3] && !std::strcmp(name, "REF")) {
+          entry.target = node.attribute("href").as_string();
+          seen[3] = true;
+        } else if (!seen[4] && !std::strcmp(name, "TITLE")) {
+          entry.title = node.text().as_string();
+          seen[4] = true;
+        }
       }
 
-      entry.playlist = m_playlist;
-      entry.playlistArtist = creator;
-      entry.playlistComment = comment;
-      entry.playlistImage = image;
-      entry.playlistTitle = title;
-
-      entries.push_back(entry);
+      entry.track = t;
+      entry.header = header;
 
       t++;
     }
@@ -92,20 +125,16 @@ void ASX::parse(Entries &entries) {
 }
 
 void ASX::writePreProcess(List &list) {
-  for (Entries::iterator it = list.entries.begin(); it != list.entries.end();) {
-    if (!isUri(it->target.string()) && !it->target.is_relative()) {
+  compactEntries(list.entries, [](Entry &entry) {
+    if (!isUri(entry.target.string()) && !entry.target.is_relative()) {
       if (!flags[32])
-        cwar << "Skipping absolute path: " << it->target << std::endl;
-
-      it = list.entries.erase(it);
+        cwar << "Skipping absolute path: " << entry.target << std::endl;
 
-      continue;
+      return false;
     }
 
-    it->track = std::distance(list.entries.begin(), it) + 1;
-
-    it++;
-  }
+    return true;
+  });
 }
 
 const bool ASX::write(const List &list) {
@@ -26,4 +26,5 @@ public:
   void parse(Entries &entries) override;
   void writePreProcess(List &list) override;
   const bool write(const List &list) override;
+  const Fields fields() const override { return Fields().set(); };
 };
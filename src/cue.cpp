@@ -21,86 +21,121 @@
 #include <cctype>
 #include <iterator>
 #include <iomanip>
-#include <sstream>
+
+static const bool startsWith(std::string_view line, std::string_view prefix) {
+  return (line.substr(0, prefix.size()) == prefix);
+}
+
+/**
+ * Text after the first space of a line, as split(line, " ") leaves it.
+ */
+static const std::string_view value(std::string_view line) {
+  const std::size_t pos = line.find(' ');
+
+  if (!pos)
+    return std::string_view();
+
+  return line.substr((pos == std::string_view::npos) ? 0 : pos + 1);
+}
+
+/**
+ * Count lines that may be entry files.
+ */
+static const std::size_t countFiles(std::string_view data) {
+  std::size_t count = 0;
+
+  while (!data.empty()) {
+    const std::size_t end = std::min(data.find('\n'), data.size());
+
+    count += startsWith(data.substr(0, end), "FILE");
+    data.remove_prefix(std::min(end + 1, data.size()));
+  }
+
+  return count;
+}
 
 void CUE::parse(Entries &entries) {
-  std::ifstream file(m_playlist);
-  std::string comment, image, line, performer, rem, title;
+  LineReader file(m_playlist);
+  std::shared_ptr<const Header> header;
+  std::string comment, image, performer, title;
+  std::string_view line, rem;
   bool invalidTrack(false), singleFileCueSheet(false);
 
+  entries.reserve(entries.size() + countFiles(file.pending()));
+
   while (!file.eof()) {
-    while ((line.rfind("FILE", 0) == std::string::npos) && !file.eof()) {
-      if (line.rfind("TITLE", 0) != std::string::npos)
-        title = unquote(split(line, " ").second);
+    while (!startsWith(line, "FILE") && !file.eof()) {
+      if (startsWith(line, "TITLE"))
+        title = unquote(value(line));
 
-      if (line.rfind("PERFORMER", 0) != std::string::npos)
-        performer = unquote(split(line, " ").second);
+      if (startsWith(line, "PERFORMER"))
+        performer = unquote(value(line));
 
-      if (line.rfind("REM", 0) != std::string::npos) {
-        rem = split(line, " ").second;
+      if (startsWith(line, "REM")) {
+        rem = value(line);
 
-        if (rem.rfind("COMMENT", 0) != std::string::npos)
-          comment = unquote(split(rem, " ").second);
-        if (rem.rfind("IMAGE", 0) != std::string::npos)
-          image = unquote(split(rem, " ").second);
+        if (startsWith(rem, "COMMENT"))
+          comment = unquote(value(rem));
+        if (startsWith(rem, "IMAGE"))
+          image = unquote(value(rem));
       }
 
-      std::getline(file, line);
+      file.getline(line);
     }
 
-    if (line.rfind("FILE", 0) != std::string::npos) {
+    if (startsWith(line, "FILE")) {
       Entry entry;
       bool validTrack(false);
 
-      entry.target = unquote(split(line, " ").second);
+      entry.target = unquote(value(line));
 
-      std::getline(file, line);
+      file.getline(line);
 
-      while ((line.rfind("FILE", 0) == std::string::npos) && !file.eof()) {
-        while (line.rfind(" ", 0) != std::string::npos)
-          line = line.substr(1);
+      while (!startsWith(line, "FILE") && !file.eof()) {
+        line.remove_prefix(std::min(line.find_first_not_of(' '), line.size()));
 
-        if (line.rfind("TRACK", 0) != std::string::npos) {
-          std::string track = line.substr(6, 3);
+        if (startsWith(line, "TRACK")) {
+          std::string_view track =
+              (line.size() >= 6) ? line.substr(6, 3) : std::string_view();
 
           if (entry.track != 0)
             singleFileCueSheet = true;
 
-          while (!track.empty() && std::isspace(track.back()))
-            track.pop_back();
+          while (!track.empty() && std::isspace((unsigned char)track.back()))
+            track.remove_suffix(1);
 
-          entry.track = std::stoi(track);
+          entry.track = toInt(track);
 
           if (entry.track < 100)
             validTrack = true;
         }
 
-        if (line.rfind("TITLE", 0) != std::string::npos)
-          entry.title = unquote(split(line, " ").second);
-
-        if (line.rfind("PERFORMER", 0) != std::string::npos)
-          entry.artist = unquote(split(line, " ").second);
-
-        if (line.rfind("REM", 0) != std::string::npos) {
-          rem = split(line, " ").second;
-
-          if (rem.rfind("ALBUM", 0) != std::string::npos)
-            entry.album = unquote(split(rem, " ").second);
-          if (rem.rfind("COMMENT", 0) != std::string::npos)
-            entry.comment = unquote(split(rem, " ").second);
-          if (rem.rfind("DURATION", 0) != std::string::npos)
-            entry.duration = std::stoi(split(rem, " ").second);
-          if (rem.rfind("IDENTIFIER", 0) != std::string::npos)
-            entry.identifier = unquote(split(rem, " ").second);
-          if (rem.rfind("IMAGE", 0) != std::string::npos)
-            entry.image = unquote(split(rem, " ").second);
-          if (rem.rfind("INFO", 0) != std::string::npos)
-            entry.info = unquote(split(rem, " ").second);
-          if (rem.rfind("TRACK", 0) != std::string::npos)
-            entry.albumTrack = std::stoi(split(rem, " ").second);
+        if (startsWith(line, "TITLE"))
+          entry.title = unquote(value(line));
+
+        if (startsWith(line, "PERFORMER"))
+          entry.artist = unquote(value(line));
+
+        if (startsWith(line, "REM")) {
+          rem = value(line);
+
+          if (startsWith(rem, "ALBUM"))
+            entry.album = unquote(value(rem));
+          if (startsWith(rem, "COMMENT"))
+            entry.comment = unquote(value(rem));
+          if (startsWith(rem, "DURATION"))
+            entry.duration = toInt(value(rem));
+          if (startsWith(rem, "IDENTIFIER"))
+            entry.identifier = unquote(value(rem));
+          if (startsWith(rem, "IMAGE"))
+            entry.image = unquote(value(rem));
+          if (startsWith(rem, "INFO"))
+            entry.info = unquote(value(rem));
+          if (startsWith(rem, "TRACK"))
+            entry.albumTrack = toInt(value(rem));
         }
 
-        std::getline(file, line);
+        file.getline(line);
       }
 
       invalidTrack = !validTrack;
@@ -108,22 +143,23 @@ void CUE::parse(Entries &entries) {
       if ((invalidTrack || singleFileCueSheet) && !flags[31])
         break;
 
-      entry.playlist = m_playlist;
-      entry.playlistArtist = performer;
-      entry.playlistComment = comment;
-      entry.playlistImage = image;
-      entry.playlistTitle = title;
+      // Entries share a header until a playlist field changes.
+      if (!header || (header->artist != performer) ||
+          (header->comment != comment) || (header->image.native() != image) ||
+          (header->title != title))
+        header = std::make_shared<Header>(
+            Header{image, m_playlist, performer, comment, title});
+
+      entry.header = header;
 
-      entries.push_back(entry);
+      entries.push_back(std::move(entry));
 
       continue;
     }
 
-    std::getline(file, line);
+    file.getline(line);
   }
 
-  file.close();
-
   if (file.bad() || invalidTrack || singleFileCueSheet) {
     cwar << "Playlist parse error(s): " << m_playlist << std::endl;
 
@@ -139,20 +175,16 @@ void CUE::parse(Entries &entries) {
 }
 
 void CUE::writePreProcess(List &list) {
-  for (Entries::iterator it = list.entries.begin(); it != list.entries.end();) {
-    if (isUri(it->target.string())) {
+  compactEntries(list.entries, [](Entry &entry) {
+    if (isUri(entry.target.string())) {
       if (!flags[32])
-        cwar << "Skipping URI: " << it->target << std::endl;
-
-      it = list.entries.erase(it);
+        cwar << "Skipping URI: " << entry.target << std::endl;
 
-      continue;
+      return false;
     }
 
-    it->track = std::distance(list.entries.begin(), it) + 1;
-
-    it++;
-  }
+    return true;
+  });
 }
 
 const bool CUE::write(const List &list) {
@@ -201,9 +233,11 @@ const bool CUE::write(const List &list) {
       if (!entry.title.empty())
         file << "    TITLE " << std::quoted(entry.title) << std::endl;
       if (!entry.artist.empty())
-        file << "    PERFORMER " << std::quoted(entry.artist) << std::endl;
+        file << "    PERFORMER " << std::quoted(entry.artist.view())
+             << std::endl;
       if (!entry.album.empty())
-        file << "    REM ALBUM " << std::quoted(entry.album) << std::endl;
+        file << "    REM ALBUM " << std::quoted(entry.album.view())
+             << std::endl;
       if (!entry.comment.empty())
         file << "    REM COMMENT " << std::quoted(entry.comment) << std::endl;
       if (entry.duration > 0)
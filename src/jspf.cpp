@@ -17,72 +17,142 @@
 
 #include <rapidjson/document.h>
 #include <rapidjson/error/en.h>
-#include <rapidjson/istreamwrapper.h>
 #include <rapidjson/ostreamwrapper.h>
 #include <rapidjson/prettywriter.h>
 
 #include "jspf.h"
 
+#include <bitset>
+#include <cstring>
+#include <string_view>
+
 #define JSPF_ROOT "playlist"
 
 using namespace rapidjson;
 
+static const std::string_view view(const rapidjson::Value &value) {
+  return std::string_view(value.GetString(), value.GetStringLength());
+}
+
+/**
+ * Read entry fields from a track object. The first member of each name is
+ * used, as FindMember() would find it.
+ */
+static void readTrack(const rapidjson::Value &track, Entry &entry) {
+  std::bitset<10> seen;
+
+  for (const auto &member : track.GetObject()) {
+    const char *name = member.name.GetString();
+    const rapidjson::Value &value = member.value;
+
+    if (!seen[0] && !std::strcmp(name, "album")) {
+      if (value.IsString())
+        entry.album = view(value);
+      seen[0] = true;
+    } else if (!seen[1] && !std::strcmp(name, "annotation")) {
+      if (value.IsString())
+        entry.comment = view(value);
+      seen[1] = true;
+    } else if (!seen[2] && !std::strcmp(name, "creator")) {
+      if (value.IsString())
+        entry.artist = view(value);
+      seen[2] = true;
+    } else if (!seen[3] && !std::strcmp(name, "duration")) {
+      if (value.IsInt())
+        entry.duration = value.GetInt();
+      seen[3] = true;
+    } else if (!seen[4] && !std::strcmp(name, "identifier")) {
+      if (value.IsString())
+        entry.identifier = view(value);
+      seen[4] = true;
+    } else if (!seen[5] && !std::strcmp(name, "image")) {
+      if (value.IsString())
+        entry.image = view(value);
+      seen[5] = true;
+    } else if (!seen[6] && !std::strcmp(name, "info")) {
+      if (value.IsString())
+        entry.info = view(value);
+      seen[6] = true;
+    } else if (!seen[7] && !std::strcmp(name, "location")) {
+      if (value.IsString())
+        entry.target = view(value);
+      seen[7] = true;
+    } else if (!seen[8] && !std::strcmp(name, "title")) {
+      if (value.IsString())
+        entry.title = view(value);
+      seen[8] = true;
+    } else if (!seen[9] && !std::strcmp(name, "trackNum")) {
+      if (value.IsInt())
+        entry.albumTrack = value.GetInt();
+      seen[9] = true;
+    }
+  }
+}
+
 void JSPF::parse(Entries &entries) {
-  std::ifstream file(m_playlist);
-  rapidjson::IStreamWrapper plWrapper(file);
+  MappedFile file(m_playlist);
   rapidjson::Document doc;
-  rapidjson::ParseResult result(doc.ParseStream(plWrapper));
+  rapidjson::ParseResult result;
+  const rapidjson::Value *tracks = nullptr;
   std::string comment, creator, image, title;
 
-  file.close();
+  // Strings are unescaped in place and referenced from the mapped file.
+  if (!file.bad())
+    result = doc.ParseInsitu(file.data());
+
+  const bool root =
+      doc.IsObject() && doc.HasMember(JSPF_ROOT) && doc[JSPF_ROOT].IsObject();
+
+  if (result && !file.bad() && root) {
+    std::bitset<5> seen;
+
+    for (const auto &member : doc[JSPF_ROOT].GetObject()) {
+      const char *name = member.name.GetString();
+      const rapidjson::Value &value = member.value;
+
+      if (!seen[0] && !std::strcmp(name, "annotation")) {
+        if (value.IsString())
+          comment = view(value);
+        seen[0] = true;
+      } else if (!seen[1] && !std::strcmp(name, "creator")) {
+        if (value.IsString())
+          creator = view(value);
+        seen[1] = true;
+      } else if (!seen[2] && !std::strcmp(name, "image")) {
+        if (value.IsString())
+          image = view(value);
+        seen[2] = true;
+      } else if (!seen[3] && !std::strcmp(name, "title")) {
+        if (value.IsString())
+          title = view(value);
+        seen[3] = true;
+      } else if (!seen[4] && !std::strcmp(name, "track")) {
+        if (value.IsArray())
+          tracks = &value;
+        seen[4] = true;
+      }
+    }
+
+    const std::shared_ptr<const Header> header = std::make_shared<Header>(
+        Header{image, m_playlist, creator, comment, title});
+
+    if (tracks) {
+      entries.reserve(entries.size() + tracks->Size());
+
+      int t = 0;
+      for (const rapidjson::Value &track : tracks->GetArray()) {
+        t++;
+
+        if (!track.IsObject())
+          continue;
+
+        Entry &entry = entries.emplace_back();
+
+        readTrack(track, entry);
 
-  if (result && !file.bad() && doc.HasMember(JSPF_ROOT)) {
-    if (doc[JSPF_ROOT].HasMember("annotation"))
-      comment = doc[JSPF_ROOT]["annotation"].GetString();
-    if (doc[JSPF_ROOT].HasMember("creator"))
-      creator = doc[JSPF_ROOT]["creator"].GetString();
-    if (doc[JSPF_ROOT].HasMember("image"))
-      image = doc[JSPF_ROOT]["image"].GetString();
-    if (doc[JSPF_ROOT].HasMember("title"))
-      title = doc[JSPF_ROOT]["title"].GetString();
-
-    rapidjson::GenericArray tracks = doc[JSPF_ROOT]["track"].GetArray();
-
-    int t = 1;
-    for (const rapidjson::GenericValue<
-             UTF8<char>, MemoryPoolAllocator<CrtAllocator>> &track : tracks) {
-      Entry entry;
-
-      if (track.HasMember("album"))
-        entry.album = track["album"].GetString();
-      if (track.HasMember("annotation"))
-        entry.comment = track["annotation"].GetString();
-      if (track.HasMember("creator"))
-        entry.artist = track["creator"].GetString();
-      if (track.HasMember("duration"))
-        entry.duration = track["duration"].GetInt();
-      if (track.HasMember("identifier"))
-        entry.identifier = track["identifier"].GetString();
-      if (track.HasMember("image"))
-        entry.image = track["image"].GetString();
-      if (track.HasMember("info"))
-        entry.info = track["info"].GetString();
-      if (track.HasMember("location"))
-        entry.target = track["location"].GetString();
-      if (track.HasMember("title"))
-        entry.title = track["title"].GetString();
-      if (track.HasMember("trackNum"))
-        entry.albumTrack = track["trackNum"].GetInt();
-      entry.track = t;
-      entry.playlist = m_playlist;
-      entry.playlistArtist = creator;
-      entry.playlistComment = comment;
-      entry.playlistImage = image;
-      entry.playlistTitle = title;
-
-      entries.push_back(entry);
-
-      t++;
+        entry.track = t;
+        entry.header = header;
+      }
     }
   } else {
     cwar << "Playlist parse error(s): " << m_playlist << std::endl;
@@ -90,7 +160,7 @@ void JSPF::parse(Entries &entries) {
     if (!result)
       cwar << rapidjson::GetParseError_En(result.Code()) << std::endl;
 
-    if (!doc.HasMember(JSPF_ROOT))
+    if (!root)
       cwar << "Unrecognized root" << std::endl;
   }
 }
@@ -19,102 +19,178 @@
 
 #include <cmath>
 #include <iomanip>
-#include <regex>
+
+static const bool startsWith(std::string_view line, std::string_view prefix) {
+  return (line.substr(0, prefix.size()) == prefix);
+}
+
+/**
+ * Count lines that may be entry targets.
+ */
+static const std::size_t countTargets(std::string_view data) {
+  std::size_t count = 0;
+
+  while (!data.empty()) {
+    const std::size_t end = std::min(data.find('\n'), data.size());
+
+    count += (end && (data.front() != '#'));
+    data.remove_prefix(std::min(end + 1, data.size()));
+  }
+
+  return count;
+}
+
+/**
+ * Read the next whitespace separated attribute, quoted spans included.
+ * False if there are no attributes left.
+ *
+ * @param info Attributes left to read.
+ * @param attribute Attribute read.
+ */
+static const bool nextAttribute(std::string_view &info,
+                                std::string_view &attribute) {
+  static const char *space = " \t\n\v\f\r";
+
+  for (;;) {
+    const std::size_t begin = info.find_first_not_of(space);
+    std::size_t end = begin;
+
+    if (begin == std::string_view::npos)
+      return false;
+
+    for (;;) {
+      end = std::min(info.find_first_of(space, end), info.find('"', end));
+
+      if ((end == std::string_view::npos) || (info.at(end) != '"'))
+        break;
+
+      // An unclosed quote ends the attribute and is skipped.
+      const std::size_t close = info.find('"', end + 1);
+
+      if (close == std::string_view::npos)
+        break;
+
+      end = close + 1;
+    }
+
+    end = std::min(end, info.size());
+
+    if (end == begin) {
+      info.remove_prefix(begin + 1);
+
+      continue;
+    }
+
+    attribute = info.substr(begin, end - begin);
+    info.remove_prefix(end);
+
+    return true;
+  }
+}
 
 void M3U::parse(Entries &entries) {
-  std::ifstream file(m_playlist);
-  std::string artist, image, line, title;
+  LineReader file(m_playlist);
+  const fs::path playlist =
+      fs::is_fifo(m_playlist) ? fs::current_path().append(".") : m_playlist;
+  std::shared_ptr<const Header> header;
+  std::string artist, image, title;
+  std::string_view line;
   bool invalidExtInfo(false);
-  std::regex regex(
-      "[^\\s\"]+(?:\"[^\"]*\"[^\\s\"]*)*|(?:\"[^\"]*\"[^\\s\"]*)+");
+
+  entries.reserve(entries.size() + countTargets(file.pending()));
 
   int t = 1;
   while (!file.eof()) {
-    Entry entry;
+    Entry &entry = entries.emplace_back();
 
-    while ((line.rfind("#EXTINF:", 0) == std::string::npos) &&
-           (line.rfind("#", 0) != std::string::npos) && !file.eof()) {
-      if (line.rfind("#EXTART:", 0) != std::string::npos)
-        artist = split(line, ":").second;
+    while (!startsWith(line, "#EXTINF:") && startsWith(line, "#") &&
+           !file.eof()) {
+      if (startsWith(line, "#EXTART:"))
+        artist = line.substr(8);
 
-      if (line.rfind("#EXTIMG:", 0) != std::string::npos)
-        image = split(line, ":").second;
+      if (startsWith(line, "#EXTIMG:"))
+        image = line.substr(8);
 
-      if (line.rfind("#PLAYLIST:", 0) != std::string::npos)
-        title = split(line, ":").second;
+      if (startsWith(line, "#PLAYLIST:"))
+        title = line.substr(10);
 
-      std::getline(file, line);
+      file.getline(line);
     }
 
-    if (line.rfind("#EXTINF:", 0) != std::string::npos) {
-      std::size_t pos = line.find_first_of(",");
-      std::string info;
+    if (startsWith(line, "#EXTINF:")) {
+      std::size_t pos = line.find(',');
+      std::string_view attribute, info;
 
       if (!invalidExtInfo) {
-        invalidExtInfo = (pos > line.size());
+        invalidExtInfo = (pos == std::string_view::npos);
       } else if (!flags[31]) {
+        entries.pop_back();
+
         break;
       }
 
       entry.title = line.substr(pos + 1);
 
       info = line.substr(8, pos - 8);
-      pos = info.find_first_of(' ');
-
-      entry.duration = std::stoi(info.substr(0, pos)) * 1000;
-
-      info = info.substr(pos + 1);
-      std::sregex_iterator it(info.begin(), info.end(), regex), end;
-
-      for (; it != end; ++it) {
-        KeyValue pair = split(it->str());
-        pair.second = unquote(pair.second);
-
-        if (pair.first == "album")
-          entry.album = pair.second;
-        if (pair.first == "artist")
-          entry.artist = pair.second;
-        if (pair.first == "comment")
-          entry.comment = pair.second;
-        if (pair.first == "identifier")
-          entry.identifier = pair.second;
-        if (pair.first == "image")
-          entry.image = pair.second;
-        if (pair.first == "info")
-          entry.info = pair.second;
-        if (pair.first == "title")
-          entry.title = pair.second;
-        if (pair.first == "track")
-          entry.albumTrack = std::stoi(pair.second);
+      pos = info.find(' ');
+
+      entry.duration = toInt(info.substr(0, pos)) * 1000;
+
+      if (pos != std::string_view::npos)
+        info.remove_prefix(pos + 1);
+
+      while (nextAttribute(info, attribute)) {
+        pos = attribute.find('=');
+
+        if (!pos)
+          continue;
+
+        const std::string_view key = attribute.substr(0, pos);
+        const std::string value = unquote(
+            attribute.substr((pos == std::string_view::npos) ? 0 : pos + 1));
+
+        if (key == "album")
+          entry.album = value;
+        if (key == "artist")
+          entry.artist = value;
+        if (key == "comment")
+          entry.comment = value;
+        if (key == "identifier")
+          entry.identifier = value;
+        if (key == "image")
+          entry.image = value;
+        if (key == "info")
+          entry.info = value;
+        if (key == "title")
+          entry.title = value;
+        if (key == "track")
+          entry.albumTrack = toInt(value);
       }
 
-      std::getline(file, line);
-      while (line.empty())
-        std::getline(file, line);
+      do
+        file.getline(line);
+      while (line.empty() && !file.eof());
     }
 
-    if (!line.empty() && (line.rfind("#", 0) == std::string::npos)) {
-      if (fs::is_fifo(m_playlist)) {
-        entry.playlist = fs::current_path().append(".");
-      } else {
-        entry.playlist = m_playlist;
-      }
-      entry.playlistArtist = artist;
-      entry.playlistImage = image;
-      entry.playlistTitle = title;
+    if (!line.empty() && !startsWith(line, "#")) {
+      // Entries share a header until a playlist field changes.
+      if (!header || (header->artist != artist) ||
+          (header->image.native() != image) || (header->title != title))
+        header = std::make_shared<Header>(
+            Header{image, playlist, artist, std::string(), title});
+
+      entry.header = header;
       entry.target = line;
       entry.track = t;
 
-      entries.push_back(entry);
-
       t++;
+    } else {
+      entries.pop_back();
     }
 
-    std::getline(file, line);
+    file.getline(line);
   }
 
-  file.close();
-
   if (file.bad() || invalidExtInfo) {
     cwar << "Playlist parse error(s): " << m_playlist << std::endl;
 
@@ -127,68 +203,78 @@ void M3U::parse(Entries &entries) {
 }
 
 const bool M3U::write(const List &list) {
-  std::stringstream playList;
-  std::ofstream file(m_playlist);
-
-  for (const Entry &entry : list.entries) {
-    std::stringstream extInf;
-
-    if (!fs::is_fifo(m_playlist) && !flags[18]) {
-      extInf << std::endl;
-      extInf << "#EXTINF:";
-      if (entry.duration > 0) {
-        extInf << std::ceil(entry.duration / 1000.0);
-      } else {
-        extInf << "-1";
-      }
+  writeBegin(list);
 
-      if (!entry.album.empty())
-        extInf << " album=" << std::quoted(entry.album);
-      if (!entry.artist.empty())
-        extInf << " artist=" << std::quoted(entry.artist);
-      if (!entry.comment.empty())
-        extInf << " comment=" << std::quoted(entry.comment);
-      if (!entry.identifier.empty())
-        extInf << " identifier=" << std::quoted(entry.identifier);
-      if (!entry.image.empty())
-        extInf << " image=" << std::quoted(entry.image.string());
-      if (!entry.info.empty())
-        extInf << " info=" << std::quoted(entry.info);
-      if (!entry.title.empty())
-        extInf << " title=" << std::quoted(entry.title);
-      if (entry.albumTrack)
-        extInf << " track=\"" << entry.albumTrack << "\"";
-
-      extInf << ",";
-
-      if (!entry.artist.empty() || !entry.title.empty()) {
-        extInf << entry.artist;
-
-        if (!entry.artist.empty() && !entry.title.empty())
-          extInf << " - ";
-
-        extInf << entry.title;
-      }
+  for (const Entry &entry : list.entries)
+    writeEntry(entry);
 
-      playList << extInf.rdbuf() << std::endl;
-    }
+  return writeEnd();
+}
 
-    playList << entry.target.string() << std::endl;
-  }
+const bool M3U::writeBegin(const List &list) {
+  m_file.open(writePath());
+  m_extended = !fs::is_fifo(m_playlist) && !flags[18];
 
-  if (!fs::is_fifo(m_playlist) && !flags[18]) {
-    file << "#EXTM3U" << std::endl;
-    file << "#EXTENC:UTF-8" << std::endl;
+  if (m_extended) {
+    m_file << "#EXTM3U" << std::endl;
+    m_file << "#EXTENC:UTF-8" << std::endl;
     if (!list.title.empty())
-      file << "#PLAYLIST:" << list.title << std::endl;
+      m_file << "#PLAYLIST:" << list.title << std::endl;
     if (!list.artist.empty())
-      file << "#EXTART:" << list.artist << std::endl;
+      m_file << "#EXTART:" << list.artist << std::endl;
     if (!list.image.empty())
-      file << "#EXTIMG:" << list.image.string() << std::endl;
+      m_file << "#EXTIMG:" << list.image.string() << std::endl;
+  }
+
+  return !m_file.fail();
+}
+
+void M3U::writeEntry(const Entry &entry) {
+  if (m_extended) {
+    m_file << '\n';
+    m_file << "#EXTINF:";
+    if (entry.duration > 0) {
+      m_file << std::ceil(entry.duration / 1000.0);
+    } else {
+      m_file << "-1";
+    }
+
+    if (!entry.album.empty())
+      m_file << " album=" << std::quoted(entry.album.view());
+    if (!entry.artist.empty())
+      m_file << " artist=" << std::quoted(entry.artist.view());
+    if (!entry.comment.empty())
+      m_file << " comment=" << std::quoted(entry.comment);
+    if (!entry.identifier.empty())
+      m_file << " identifier=" << std::quoted(entry.identifier);
+    if (!entry.image.empty())
+      m_file << " image=" << std::quoted(entry.image.string());
+    if (!entry.info.empty())
+      m_file << " info=" << std::quoted(entry.info);
+    if (!entry.title.empty())
+      m_file << " title=" << std::quoted(entry.title);
+    if (entry.albumTrack)
+      m_file << " track=\"" << entry.albumTrack << "\"";
+
+    m_file << ",";
+
+    if (!entry.artist.empty() || !entry.title.empty()) {
+      m_file << entry.artist;
+
+      if (!entry.artist.empty() && !entry.title.empty())
+        m_file << " - ";
+
+      m_file << entry.title;
+    }
+
+    m_file << '\n';
   }
 
-  file << playList.rdbuf();
-  file.close();
+  m_file << entry.target.string() << '\n';
+}
+
+const bool M3U::writeEnd() {
+  m_file.close();
 
-  return !file.fail();
+  return writeCommit(!m_file.fail());
 }
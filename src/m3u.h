@@ -26,4 +26,14 @@ public:
   void parse(Entries &entries) override;
   void writePreProcess(List &list) override {};
   const bool write(const List &list) override;
+  const bool writeBegin(const List &list) override;
+  void writeEntry(const Entry &entry) override;
+  const bool writeEnd() override;
+  const Fields fields() const override {
+    return fs::is_fifo(m_playlist) ? Fields() : Fields().set();
+  };
+
+private:
+  std::ofstream m_file;
+  bool m_extended = false;
 };
@@ -24,9 +24,13 @@
 #include <iostream>
 #include <iterator>
 #include <random>
+#include <unordered_map>
+#include <unordered_set>
 
 #include <unistd.h>
 
+#define STREAM_ENTRIES 4096
+
 void help() {
   std::cout << "playlist version " << ver << std::endl;
   std::cout << "Copyright (C) James D. Smith" << std::endl;
@@ -36,13 +40,14 @@ void help() {
                "[-f path] [-z] [[-O|-I]|[-R|-B path]] [-c trackpos:track] "
                "[-a [track:]target] [-e track:FIELD=value] [-r track|target] "
 #ifdef LIBCURL
-               "[-s] "
+               "[-s [-U connections]] "
 #endif
+               "[-V cachefile [-W ttl]] [-Y jobs] [-y] "
 #ifdef TAGLIB
-               "[-i] "
+               "[-i] [-F cachefile [-Z]] "
 #endif
                "[-d] [-u] [-j] [-n] [-m] [-b artist] [-k comment] [-g image] "
-               "[-t title] [-q] [-v] [-x] [-o] [-w outfile.ext] infile..."
+               "[-t title] [-q] [-v] [-x] [-X] [-o] [-w outfile.ext] infile..."
             << std::endl;
   std::cout << std::endl;
   std::cout << "Options:" << std::endl;
@@ -67,6 +72,9 @@ void help() {
   std::cout << "\t-x Preview changes (with -w)" << std::endl;
   std::cout << "\t-f In playlist relative local target base path" << std::endl;
   std::cout << "\t-z Ignore in playlist parse errors" << std::endl;
+  std::cout << "\t-X Stream entries of one in playlist (.xspf) to -l target or "
+               "-w (.m3u, .pls)"
+            << std::endl;
   std::cout
       << "\t-w Out playlist file (.asx, .cue, .jspf, .m3u, .pls, .wpl, .xspf)"
       << std::endl;
@@ -93,9 +101,20 @@ void help() {
   std::cout << "\t-m Minimal out playlist (targets only)" << std::endl;
 #ifdef LIBCURL
   std::cout << "\t-s Verify network targets" << std::endl;
+  std::cout << "\t-U Concurrent network target verifications (default "
+            << connections << ")" << std::endl;
 #endif
+  std::cout << "\t-V Target validation cache file" << std::endl;
+  std::cout << "\t-W Network target validation cache seconds (default "
+            << targetCache.ttl << ")" << std::endl;
+  std::cout << "\t-Y Worker threads (default " << jobs << ")" << std::endl;
+  std::cout << "\t-y Get entry durations from local target headers"
+            << std::endl;
 #ifdef TAGLIB
   std::cout << "\t-i Get entry metadata from local targets" << std::endl;
+  std::cout << "\t-F Target metadata cache file" << std::endl;
+  std::cout << "\t-Z Drop changed or missing targets from metadata cache"
+            << std::endl;
 #endif
   std::cout << std::endl;
   std::cout << "\t-q Quiet" << std::endl;
@@ -126,11 +145,14 @@ void help() {
 }
 
 int main(int argc, char **argv) {
-  fs::path base, image, prepend;
+  fs::path base, cache, image, metadata, prepend;
   std::string artist, comment, title;
   List list;
+  Index index;
+  Targets targets;
+  Headers outHeaders;
   std::vector<std::string> addItems, changeItems, moveItems, removeItems;
-  Playlist *outPlaylist;
+  Playlist *outPlaylist = nullptr;
 
   auto parseList = [](const std::string &arg) {
     flags[2] = (arg == "dupe");
@@ -165,22 +187,20 @@ int main(int argc, char **argv) {
     return false;
   };
 
-  const auto hasNestedList = [&](const Entries &entries) {
-    for (Entries::const_iterator it = entries.begin(); it != entries.end();
-         it++) {
-      fs::path target = processTarget(it->target.string());
-
-      if (!prepend.empty() && !it->nestedEntry) {
-        target = absPath(prepend, target);
-      } else {
-        target = absPath(it->playlist.parent_path(), target);
-      }
+  // The nested playlist an entry targets, or an empty path.
+  const auto nestedList = [&](const Entry &entry) {
+    fs::path target = processTarget(entry.target.string());
 
-      if (isPlaylist(target.extension().string()) && fs::exists(target))
-        return true;
+    if (!prepend.empty() && !entry.nestedEntry) {
+      target = absPath(prepend, target);
+    } else {
+      target = absPath(entry.playlist().parent_path(), target);
     }
 
-    return false;
+    if (isPlaylist(target.extension().string()) && resolver.exists(target))
+      return target;
+
+    return fs::path();
   };
 
   auto parseError = [](const std::string &item) {
@@ -189,6 +209,14 @@ int main(int argc, char **argv) {
     std::exit(2);
   };
 
+  const auto parseCount = [&](const std::string &item) {
+    if (item.empty() || !std::all_of(item.begin(), item.end(), isdigit) ||
+        (std::stoi(item) < 1))
+      parseError(item);
+
+    return std::stoi(item);
+  };
+
   const auto transformPath = [&](const fs::path &basePath, fs::path &path) {
     fs::path target = absPath(basePath, path);
 
@@ -203,26 +231,216 @@ int main(int argc, char **argv) {
     }
   };
 
+  // The absolute path of an entry target or image, processed in place.
+  const auto computeTargets = [&](const Entry &entry, fs::path &target,
+                                  bool &local) {
+    target = processTarget(target.string());
+
+    if (!prepend.empty() && !entry.nestedEntry)
+      target = absPath(prepend, target);
+
+    local = !isUri(target.string());
+
+    return absPath(entry.playlist().parent_path(), target);
+  };
+
+  // Take the out playlist fields from entry source playlists, the first of
+  // each being kept and the distinct values counted.
+  const auto mergeHeader = [&](const Entry &entry) {
+    if (!entry.playlistImage().empty()) {
+      fs::path plImage = processTarget(entry.playlistImage().string());
+
+      if (list.image.empty() || (plImage != list.image))
+        list.images++;
+
+      if (list.image.empty() || (!list.validImage && (plImage != list.image))) {
+        list.image = entry.playlistImage();
+        list.validImage =
+            validTarget(computeTargets(entry, list.image, list.localImage));
+      }
+    }
+
+    if (!entry.playlistArtist().empty()) {
+      if (list.artist.empty() || (entry.playlistArtist() != list.artist))
+        list.artists++;
+
+      if (list.artist.empty())
+        list.artist = entry.playlistArtist();
+    }
+
+    if (!entry.playlistComment().empty()) {
+      if (list.comment.empty() || (entry.playlistComment() != list.comment))
+        list.comments++;
+
+      if (list.comment.empty())
+        list.comment = entry.playlistComment();
+    }
+
+    if (!entry.playlistTitle().empty()) {
+      if (list.title.empty() || (entry.playlistTitle() != list.title))
+        list.titles++;
+
+      if (list.title.empty())
+        list.title = entry.playlistTitle();
+    }
+  };
+
+  // Out playlist fields given as options replace those merged.
+  const auto overrideHeader = [&]() {
+    if (!image.empty()) {
+      list.image = image;
+      list.localImage = !isUri(list.image.string());
+      list.validImage = validTarget(list.image);
+      list.images = !image.empty();
+    }
+
+    if (!artist.empty()) {
+      list.artist = artist;
+      list.artists = !artist.empty();
+    }
+
+    if (!comment.empty()) {
+      list.comment = comment;
+      list.comments = !comment.empty();
+    }
+
+    if (!title.empty()) {
+      list.title = title;
+      list.titles = !title.empty();
+    }
+  };
+
+  const auto checkOutPlaylist = [&]() {
+    if (fs::exists(list.playlist) && !flags[22] && !flags[30]) {
+      std::cerr << "File exists: " << list.playlist << std::endl;
+
+      std::exit(2);
+    }
+
+    if ((!base.empty() && flags[23]) || (flags[23] && flags[25]) ||
+        (!base.empty() && flags[14]) || (flags[14] && flags[25])) {
+      std::cerr << "Cannot combine absolute and relative path transforms"
+                << std::endl;
+
+      std::exit(2);
+    }
+  };
+
+  // Entries without a target, or unfound with -o, are not written out.
+  const auto dropEntry = [](const Entry &entry) {
+    return entry.target.empty() || (!entry.validTarget && flags[29]);
+  };
+
+  // Transform entry paths for the out playlist, and move the entry to it.
+  const auto outEntry = [&](Entry &entry) {
+    if (entry.localTarget)
+      transformPath(entry.playlist().parent_path(), entry.target);
+
+    if (!entry.image.empty()) {
+      if (!entry.validImage && flags[29]) {
+        entry.image.clear();
+      } else if (entry.localImage) {
+        transformPath(entry.playlist().parent_path(), entry.image);
+      }
+    }
+
+    entry.setPlaylist(list.playlist, outHeaders);
+  };
+
+  // Transformed local paths are checked again, from the out playlist.
+  const auto restatTargets = [&](Entries &entries) {
+    targets.clear();
+
+    for (Entry &entry : entries) {
+      if (entry.localTarget)
+        targets.emplace_back(
+            absPath(list.playlist.parent_path(), processTarget(entry.target)),
+            &entry.validTarget);
+
+      if (!entry.image.empty() && entry.localImage)
+        targets.emplace_back(
+            absPath(list.playlist.parent_path(), processTarget(entry.image)),
+            &entry.validImage);
+    }
+
+    statTargets(targets);
+  };
+
+  const auto outImage = [&]() {
+    if (list.image.empty())
+      return;
+
+    if (!list.validImage && flags[29]) {
+      list.image.clear();
+    } else if (list.localImage) {
+      transformPath(list.playlist.parent_path(), list.image);
+      list.validImage = resolver.exists(
+          absPath(list.playlist.parent_path(), processTarget(list.image)));
+    }
+  };
+
+  const auto outWarnings = [&]() {
+    if (list.unfoundTargets > 0)
+      cwar << "WARNING: out playlist has " << list.unfoundTargets
+           << " unfound entry target(s)" << std::endl;
+
+    if (flags[18])
+      return;
+
+    if (list.unfoundImages > 0)
+      cwar << "WARNING: out playlist has " << list.unfoundImages
+           << " unfound entry image(s)" << std::endl;
+
+    if (!list.image.empty() && !list.validImage)
+      cwar << "WARNING: out playlist image not found" << std::endl;
+
+    if (list.artists > 1)
+      cwar << "WARNING: 1 of " << list.artists
+           << " playlist artists auto-selected" << std::endl;
+
+    if (list.comments > 1)
+      cwar << "WARNING: 1 of " << list.comments
+           << " playlist comments auto-selected" << std::endl;
+
+    if (list.images > 1)
+      cwar << "WARNING: 1 of " << list.images
+           << " playlist images auto-selected" << std::endl;
+
+    if (list.titles > 1)
+      cwar << "WARNING: 1 of " << list.titles
+           << " playlist titles auto-selected" << std::endl;
+  };
+
+  const auto nothingToDo = [&]() {
+    if ((cwar.rdbuf()->in_avail() != 0) && !flags[33])
+      std::cerr << cwar.rdbuf();
+    std::cerr << "Nothing to do!" << std::endl;
+
+    std::cout << "playlist -h for usage information" << std::endl;
+
+    return 2;
+  };
+
   int c;
 #ifdef LIBCURL
 #ifdef TAGLIB
   while ((c = getopt(argc, argv,
-                     "a:A:b:B:c:C:dD:e:E:f:g:G:iIjJ:k:K:l:L:mM:nN:oOpP:r:RsS:t:"
-                     "T:uvw:xzqh")) != -1) {
+                     "a:A:b:B:c:C:dD:e:E:f:F:g:G:iIjJ:k:K:l:L:mM:nN:oOpP:r:RsS:"
+                     "t:T:uU:vV:W:w:xXyY:zZqh")) != -1) {
 #else
   while ((c = getopt(argc, argv,
                      "a:A:b:B:c:C:dD:e:E:f:g:G:IjJ:k:K:l:L:mM:nN:oOpP:r:RsS:t:"
-                     "T:uvw:xzqh")) != -1) {
+                     "T:uU:vV:W:w:xXyY:zqh")) != -1) {
 #endif
 #else
 #ifdef TAGLIB
   while ((c = getopt(argc, argv,
-                     "a:A:b:B:c:C:dD:e:E:f:g:G:ijJ:k:K:Il:L:mM:nN:oOpP:r:RS:t:"
-                     "T:uvw:xzqh")) != -1) {
+                     "a:A:b:B:c:C:dD:e:E:f:F:g:G:ijJ:k:K:Il:L:mM:nN:oOpP:r:RS:"
+                     "t:T:uvV:W:w:xXyY:zZqh")) != -1) {
 #else
   while ((c = getopt(argc, argv,
                      "a:A:b:B:c:C:dD:e:E:f:g:G:IjJ:k:K:l:L:mM:nN:oOpP:r:RS:t:T:"
-                     "uvw:xzqh")) != -1) {
+                     "uvV:W:w:xXyY:zqh")) != -1) {
 #endif
 #endif
     switch (c) {
@@ -278,6 +496,12 @@ int main(int argc, char **argv) {
       prepend = absPath(fs::current_path(), fs::path(optarg));
 
       break;
+#ifdef TAGLIB
+    case 'F':
+      metadata = absPath(fs::current_path(), optarg);
+
+      break;
+#endif
     case 'g':
       image = fs::path(optarg);
 
@@ -403,19 +627,51 @@ int main(int argc, char **argv) {
     case 'u':
       flags[29] = true;
 
+      break;
+#ifdef LIBCURL
+    case 'U':
+      connections = parseCount(optarg);
+
+      break;
+#endif
+    case 'V':
+      cache = absPath(fs::current_path(), optarg);
+
       break;
     case 'w':
       list.playlist = absPath(fs::current_path(), optarg);
 
+      break;
+    case 'W':
+      targetCache.ttl = parseCount(optarg);
+
       break;
     case 'x':
       flags[30] = true;
 
+      break;
+    case 'X':
+      flags[38] = true;
+
+      break;
+    case 'y':
+      flags[37] = true;
+
+      break;
+    case 'Y':
+      jobs = parseCount(optarg);
+
       break;
     case 'z':
       flags[31] = true;
 
       break;
+#ifdef TAGLIB
+    case 'Z':
+      flags[36] = true;
+
+      break;
+#endif
     case 'v':
       flags[32] = true;
 
@@ -435,125 +691,467 @@ int main(int argc, char **argv) {
     }
   }
 
-  for (; optind < argc; optind++) {
-    const fs::path inPl = absPath(fs::current_path(), argv[optind]);
-    Entries entries;
+  if (!cache.empty()) {
+    targetCache.load(cache);
 
-    if (fs::exists(inPl)) {
-      playlist(inPl)->parse(entries);
+    std::atexit([] {
+      if (!targetCache.save())
+        std::cerr << "Write fail: target cache" << std::endl;
+    });
+  }
 
-      if (flags[32])
-        std::cout << "Parsed " << entries.size() << " entries"
-                  << " from playlist file: " << inPl << std::endl;
+#ifdef TAGLIB
+  if (!metadata.empty()) {
+    metadataCache.load(metadata);
 
-      list.entries.insert(list.entries.end(), entries.begin(), entries.end());
+    std::atexit([] {
+      if (!metadataCache.save())
+        std::cerr << "Write fail: metadata cache" << std::endl;
+    });
 
-      if (list.playlist.empty() && flags[22])
-        list.playlist = inPl;
-    } else {
-      cwar << "Skipping unfound file: " << inPl << std::endl;
+    if (flags[36]) {
+      metadataCache.compact();
+
+      if (optind == argc)
+        return 0;
     }
+  } else if (flags[36]) {
+    std::cerr << "-Z option requires a metadata cache (-F)" << std::endl;
+
+    return 2;
   }
 
-  if (flags[35]) {
-    while (hasNestedList(list.entries)) {
-      Entries mergedEntries;
+#endif
+  if (flags[38]) {
+    const bool listing = (flags[1] && flags[17]);
+    Entries chunk;
+    std::size_t parsed = 0, written = 0;
+    bool begun = false;
 
-      for (Entries::const_iterator it = list.entries.begin();
-           it != list.entries.end(); it++) {
-        fs::path target = processTarget(it->target.string());
+    if (optind != (argc - 1)) {
+      std::cerr << "-X option requires one in playlist" << std::endl;
 
-        if (!prepend.empty() && !it->nestedEntry) {
-          target = absPath(prepend, target);
-        } else {
-          target = absPath(it->playlist.parent_path(), target);
-        }
+      return 2;
+    }
 
-        if (isPlaylist(target.extension().string()) && fs::exists(target)) {
-          Entries listEntries;
+    if ((flags[1] && !flags[17]) || flags[2] || flags[3] || flags[4] ||
+        flags[5] || flags[6] || flags[7] || flags[8] || flags[9] ||
+        flags[13] || flags[20] || flags[35] || flags[37] ||
+        !addItems.empty() || !changeItems.empty() || !moveItems.empty() ||
+        !removeItems.empty()) {
+      std::cerr << "-X option cannot be combined with -a, -c, -d, -e, -i, -j, "
+                   "-n, -r, -y, or a list other than -l target"
+                << std::endl;
 
-          playlist(target)->parse(listEntries);
+      return 2;
+    }
 
-          for (Entries::iterator it = listEntries.begin();
-               it != listEntries.end(); it++) {
-            it->nestedEntry = true;
-            mergedEntries.push_back(*it);
-          }
-        } else {
-          mergedEntries.push_back(*it);
-        }
+    const fs::path inPl = absPath(fs::current_path(), argv[optind]);
+
+    if (!fs::exists(inPl)) {
+      std::cerr << "File not found: " << inPl << std::endl;
+
+      return 2;
+    }
+
+    if (list.playlist.empty() && flags[22])
+      list.playlist = inPl;
+
+    if (!listing) {
+      if (list.playlist.empty() || flags[30]) {
+        std::cerr << "-X option requires -l target or an out playlist (-w)"
+                  << std::endl;
+
+        return 2;
       }
 
-      list.entries = mergedEntries;
+      outPlaylist = playlist(list.playlist);
     }
-  }
 
-  for (Entries::iterator it = list.entries.begin(); it != list.entries.end();
-       it++) {
-    auto computeTargets = [&](fs::path &target, bool &local, bool &valid) {
-      target = processTarget(target.string());
+    checkOutPlaylist();
+
+    // The out playlist header comes from the first entry, as all entries
+    // share the one in playlist.
+    const auto writeHeader = [&](const Entry &entry) {
+      mergeHeader(entry);
+      overrideHeader();
+      outImage();
+
+      if (!outPlaylist->writeBegin(list)) {
+        std::cerr << "Cannot stream out playlist: " << list.playlist
+                  << std::endl;
 
-      if (!prepend.empty() && !it->nestedEntry)
-        target = absPath(prepend, target);
+        std::exit(2);
+      }
 
-      local = !isUri(target.string());
-      valid = validTarget(absPath(it->playlist.parent_path(), target));
+      begun = true;
     };
 
-    if (!it->playlistImage.empty()) {
-      fs::path plImage = processTarget(it->playlistImage.string());
+    // Entries are validated, transformed and written out a chunk at a time,
+    // so memory does not grow with the in playlist.
+    const auto flush = [&]() {
+      targets.clear();
 
-      if (list.image.empty() || (plImage != list.image))
-        list.images++;
+      for (Entry &entry : chunk) {
+        targets.emplace_back(
+            computeTargets(entry, entry.target, entry.localTarget),
+            &entry.validTarget);
 
-      if (list.image.empty() || (!list.validImage && (plImage != list.image))) {
-        list.image = it->playlistImage;
+        if (!entry.image.empty())
+          targets.emplace_back(
+              computeTargets(entry, entry.image, entry.localImage),
+              &entry.validImage);
+      }
+
+      if (!list.playlist.empty())
+        validTargets(targets);
+
+      if (!list.playlist.empty()) {
+        compactEntries(chunk, [&](Entry &entry) {
+          if (dropEntry(entry))
+            return false;
+
+          if (!listing && !begun)
+            writeHeader(entry);
+
+          outEntry(entry);
 
-        computeTargets(list.image, list.localImage, list.validImage);
+          return true;
+        });
+
+        restatTargets(chunk);
       }
+
+      for (Entry &entry : chunk) {
+        if (listing) {
+          std::cout << entry.target.string() << '\n';
+          written++;
+
+          continue;
+        }
+
+        entry.track = ++written;
+
+        outPlaylist->writeEntry(entry);
+
+        list.unfoundTargets += !entry.validTarget;
+
+        if (!entry.image.empty())
+          list.unfoundImages += !entry.validImage;
+      }
+
+      chunk.clear();
+    };
+
+    chunk.reserve(STREAM_ENTRIES);
+
+    if (!playlist(inPl)->stream([&](Entry &entry) {
+          chunk.push_back(std::move(entry));
+          parsed++;
+
+          if (chunk.size() == STREAM_ENTRIES)
+            flush();
+        })) {
+      if ((cwar.rdbuf()->in_avail() != 0) && !flags[33])
+        std::cerr << cwar.rdbuf();
+      std::cerr << "Cannot stream in playlist: " << inPl << std::endl;
+
+      // An existing out playlist is left intact, as when a whole list fails
+      // to parse.
+      if (begun)
+        outPlaylist->writeAbort();
+
+      return 2;
     }
 
-    if (!it->playlistArtist.empty()) {
-      if (list.artist.empty() || (it->playlistArtist != list.artist))
-        list.artists++;
+    flush();
 
-      if (list.artist.empty())
-        list.artist = it->playlistArtist;
+    if (flags[32])
+      std::cout << "Parsed " << parsed << " entries"
+                << " from playlist file: " << inPl << std::endl;
+
+    if (!written)
+      return nothingToDo();
+
+    if (listing)
+      return 0;
+
+    if (flags[32])
+      std::cout << "Generated playlist: " << written << " entries"
+                << std::endl;
+
+    if (!outPlaylist->writeEnd()) {
+      std::cerr << "Write fail: " << list.playlist << std::endl;
+
+      return 2;
     }
 
-    if (!it->playlistComment.empty()) {
-      if (list.comment.empty() || (it->playlistComment != list.comment))
-        list.comments++;
+    if (flags[32])
+      std::cout << "Playlist successfully written: " << list.playlist
+                << std::endl;
 
-      if (list.comment.empty())
-        list.comment = it->playlistComment;
+    outWarnings();
+
+    const bool cwarEmpty = (cwar.rdbuf()->in_avail() == 0);
+
+    if (!cwarEmpty && !flags[33])
+      std::cerr << cwar.rdbuf();
+
+    return !flags[33] ? !cwarEmpty : 0;
+  }
+
+  std::vector<fs::path> inPls;
+  std::vector<Playlist *> inPlaylists;
+
+  for (; optind < argc; optind++) {
+    inPls.push_back(absPath(fs::current_path(), argv[optind]));
+    inPlaylists.push_back(fs::exists(inPls.back()) ? playlist(inPls.back())
+                                                   : nullptr);
+  }
+
+  std::vector<Entries> inEntries(inPls.size());
+  std::vector<std::string> inWarnings(inPls.size());
+
+  // Parse in playlists concurrently, keeping each one's warnings apart so
+  // that they are reported in command line order.
+  parallel(inPls.size(), [&](std::size_t i) {
+    std::stringstream warnings;
+
+    if (!inPlaylists[i])
+      return;
+
+    cwar.swap(warnings);
+    inPlaylists[i]->parse(inEntries[i]);
+    cwar.swap(warnings);
+
+    inWarnings[i] = warnings.str();
+  });
+
+  std::size_t inSize = 0, inLargest = 0;
+
+  for (const Entries &entries : inEntries) {
+    inSize += entries.size();
+    inLargest = std::max(inLargest, entries.size());
+  }
+
+  if (inLargest < inSize)
+    list.entries.reserve(inSize);
+
+  for (std::size_t i = 0; i < inPls.size(); i++) {
+    if (inPlaylists[i]) {
+      cwar << inWarnings[i];
+
+      if (flags[32])
+        std::cout << "Parsed " << inEntries[i].size() << " entries"
+                  << " from playlist file: " << inPls[i] << std::endl;
+
+      spliceEntries(list.entries, inEntries[i]);
+
+      if (list.playlist.empty() && flags[22])
+        list.playlist = inPls[i];
+    } else {
+      cwar << "Skipping unfound file: " << inPls[i] << std::endl;
     }
+  }
 
-    if (!it->playlistTitle.empty()) {
-      if (list.title.empty() || (it->playlistTitle != list.title))
-        list.titles++;
+  if (flags[35]) {
+    std::unordered_map<std::string, Entries> nested, expanded;
+    std::unordered_map<std::string, std::vector<fs::path>> nestedLinks;
+    std::unordered_map<std::string, std::size_t> references;
+    std::unordered_set<std::string> expanding;
+    std::vector<fs::path> pending;
+    Entries mergedEntries;
 
-      if (list.title.empty())
-        list.title = it->playlistTitle;
+    // Find the nested playlist of each entry, queueing those not yet seen.
+    // Playlists are keyed on their canonical path, so one reached through a
+    // symlinked directory is still seen once, and cycles through it end.
+    const auto link = [&](const Entries &entries) {
+      std::vector<fs::path> links;
+
+      links.reserve(entries.size());
+
+      for (const Entry &entry : entries) {
+        const fs::path path = nestedList(entry);
+
+        links.push_back(path.empty() ? path : resolver.canonical(path));
+
+        if (links.back().empty())
+          continue;
+
+        references[links.back().string()]++;
+
+        if (nested.emplace(links.back().string(), Entries()).second)
+          pending.push_back(path);
+      }
+
+      return links;
+    };
+
+    const std::vector<fs::path> links = link(list.entries);
+
+    // Each distinct nested playlist is parsed once, a nesting level at a
+    // time, with the playlists of a level parsed concurrently.
+    while (!pending.empty()) {
+      std::vector<fs::path> level;
+      std::vector<std::string> levelKeys;
+      std::vector<Playlist *> levelPlaylists;
+      std::vector<Entries *> levelEntries;
+
+      level.swap(pending);
+
+      for (const fs::path &path : level) {
+        levelKeys.push_back(resolver.canonical(path).string());
+        levelPlaylists.push_back(playlist(path));
+        levelEntries.push_back(&nested.at(levelKeys.back()));
+      }
+
+      std::vector<std::string> levelWarnings(level.size());
+
+      parallel(level.size(), [&](std::size_t i) {
+        std::stringstream warnings;
+
+        cwar.swap(warnings);
+        levelPlaylists[i]->parse(*levelEntries[i]);
+        cwar.swap(warnings);
+
+        levelWarnings[i] = warnings.str();
+      });
+
+      for (std::size_t i = 0; i < level.size(); i++) {
+        cwar << levelWarnings[i];
+
+        for (Entry &entry : *levelEntries[i])
+          entry.nestedEntry = true;
+
+        nestedLinks[levelKeys[i]] = link(*levelEntries[i]);
+      }
     }
 
-    computeTargets(it->target, it->localTarget, it->validTarget);
+    // Splice each nested playlist in place of the entries targeting it,
+    // expanding each once and skipping references back into itself. Entries
+    // are moved, and only copied for playlists referenced more than once.
+    std::function<void(Entries &, const std::vector<fs::path> &, Entries &)>
+        expand = [&](Entries &entries, const std::vector<fs::path> &links,
+                     Entries &merged) {
+          for (std::size_t i = 0; i < entries.size(); i++) {
+            const std::string key = links[i].string();
+
+            if (links[i].empty()) {
+              merged.push_back(std::move(entries[i]));
+
+              continue;
+            }
+
+            references.at(key)--;
+
+            if (expanding.count(key)) {
+              cwar << "Skipping nested playlist cycle: " << links[i]
+                   << std::endl;
+
+              continue;
+            }
+
+            std::unordered_map<std::string, Entries>::iterator found =
+                expanded.find(key);
+
+            if (found == expanded.end()) {
+              Entries flat;
+
+              flat.reserve(nested.at(key).size());
+              expanding.insert(key);
+              expand(nested.at(key), nestedLinks.at(key), flat);
+              expanding.erase(key);
+
+              found = expanded.emplace(key, std::move(flat)).first;
+            }
+
+            if (references.at(key) > 0) {
+              merged.insert(merged.end(), found->second.begin(),
+                            found->second.end());
+            } else {
+              spliceEntries(merged, found->second);
+            }
+          }
+        };
+
+    mergedEntries.reserve(list.entries.size());
+    expand(list.entries, links, mergedEntries);
+
+    list.entries = std::move(mergedEntries);
+  }
+
+  for (Entries::iterator it = list.entries.begin(); it != list.entries.end();
+       it++) {
+    mergeHeader(*it);
+
+    targets.emplace_back(computeTargets(*it, it->target, it->localTarget),
+                         &it->validTarget);
 
     if (!it->image.empty())
-      computeTargets(it->image, it->localImage, it->validImage);
+      targets.emplace_back(computeTargets(*it, it->image, it->localImage),
+                           &it->validImage);
+
+    if (it->localTarget && !list.relative)
+      list.relative =
+          (it->target.is_relative() || !it->target.has_parent_path());
+  }
+
+  validTargets(targets);
+
+  const bool listing = flags[1] || flags[2] || flags[3] || flags[4] ||
+                       flags[5] || flags[6] || flags[7] || flags[8];
+
+  if (flags[13] || flags[37]) {
+    std::vector<Entry *> tagged;
+    std::vector<char> read;
+    Fields fields;
+
+    // Listings and show exit before the out playlist is written.
+    if (list.playlist.empty() || flags[30] || listing) {
+      fields.set();
+    } else if (!flags[18]) {
+      outPlaylist = playlist(list.playlist);
+      fields = outPlaylist->fields();
+    }
+
+    // Duplicate and unique tracks are matched on artist and title.
+    if (flags[2] || flags[8] || flags[9])
+      fields.set(FieldArtist).set(FieldTitle);
+
+    if (!flags[13])
+      fields &= Fields().set(FieldDuration);
+
+    const bool durations = (fields == Fields().set(FieldDuration));
 
-    if (it->localTarget) {
+    if (fields.any())
+      for (Entry &entry : list.entries)
+        if (entry.localTarget && entry.validTarget)
+          tagged.push_back(&entry);
+
+    read.resize(tagged.size());
+
+    parallel(tagged.size(), [&](std::size_t i) {
 #ifdef TAGLIB
-      if (it->validTarget && flags[13])
-        fetchMetadata(*it);
+      if (!durations) {
+        read[i] = fetchMetadata(*tagged[i], fields);
+
+        return;
+      }
 
 #endif
-      if (!list.relative)
-        list.relative =
-            (it->target.is_relative() || !it->target.has_parent_path());
-    }
+      read[i] = fetchDuration(*tagged[i]);
+    });
+
+    for (std::size_t i = 0; i < tagged.size(); i++)
+      if (!read[i])
+        cwar << (durations ? "Could not read target duration: "
+                           : "Could not read target tag: ")
+             << tagged[i]->target << std::endl;
+  }
 
-    it->duplicateTarget = find(*it, list.entries) < it;
+  for (Entry &entry : list.entries) {
+    entry.duplicateTarget = index.duplicate(entry);
+    index.insert(entry);
   }
 
   if (list.playlist.empty()) {
@@ -563,53 +1161,20 @@ int main(int argc, char **argv) {
       return 2;
     }
   } else {
-    if (fs::exists(list.playlist) && !flags[22] && !flags[30]) {
-      std::cerr << "File exists: " << list.playlist << std::endl;
+    checkOutPlaylist();
 
-      return 2;
-    }
-
-    if ((!base.empty() && flags[23]) || (flags[23] && flags[25]) ||
-        (!base.empty() && flags[14]) || (flags[14] && flags[25])) {
-      std::cerr << "Cannot combine absolute and relative path transforms"
-                << std::endl;
-
-      return 2;
-    }
-
-    outPlaylist = playlist(list.playlist);
+    if (!outPlaylist)
+      outPlaylist = playlist(list.playlist);
 
     for (Entries::iterator it = list.entries.begin(); it != list.entries.end();
          it++)
       it->track = std::distance(list.entries.begin(), it) + 1;
 
-    if (!image.empty()) {
-      list.image = image;
-      list.localImage = !isUri(list.image.string());
-      list.validImage = validTarget(list.image);
-      list.images = !image.empty();
-    }
-
-    if (!artist.empty()) {
-      list.artist = artist;
-      list.artists = !artist.empty();
-    }
-
-    if (!comment.empty()) {
-      list.comment = comment;
-      list.comments = !comment.empty();
-    }
-
-    if (!title.empty()) {
-      list.title = title;
-      list.titles = !title.empty();
-    }
+    overrideHeader();
 
     for (const std::string &moveItem : moveItems) {
       std::pair<std::string, std::string> pair = split(moveItem, ":");
       int track, trackPos;
-      Entry entry;
-      Entries::iterator index;
 
       if (!std::all_of(pair.first.begin(), pair.first.end(), isdigit))
         parseError(moveItem);
@@ -623,12 +1188,7 @@ int main(int argc, char **argv) {
           (trackPos > list.entries.size()) || (trackPos < 1))
         parseError(moveItem);
 
-      entry = list.entries.at(track - 1);
-      index = list.entries.begin() + track - 1;
-      list.entries.erase(index);
-
-      index = list.entries.begin() + trackPos - 1;
-      list.entries.emplace(index, entry);
+      moveEntry(list.entries, track - 1, trackPos - 1);
     }
 
     for (const std::string &addItem : addItems) {
@@ -636,7 +1196,7 @@ int main(int argc, char **argv) {
       Entry entry;
       Entries::iterator index;
 
-      entry.playlist = fs::current_path().append(".");
+      entry.setPlaylist(fs::current_path().append("."));
 
       if (!pair.first.empty() &&
           std::all_of(pair.first.begin(), pair.first.end(), isdigit)) {
@@ -660,7 +1220,7 @@ int main(int argc, char **argv) {
       entry.localTarget = !isUri(entry.target.string());
       entry.validTarget = validTarget(entry.target);
 
-      list.entries.emplace(index, entry);
+      list.entries.emplace(index, std::move(entry));
     }
 
     for (const std::string &changeItem : changeItems) {
@@ -671,7 +1231,7 @@ int main(int argc, char **argv) {
       Entry entry;
 
       auto setEntry = [&](Entry &entry) {
-        entry.playlist = fs::current_path().append(".");
+        entry.setPlaylist(fs::current_path().append("."));
 
         if (key == "ta") {
           entry.target = processTarget(value);
@@ -735,53 +1295,22 @@ int main(int argc, char **argv) {
       std::shuffle(list.entries.begin(), list.entries.end(),
                    std::default_random_engine());
 
-    for (Entries::iterator it = list.entries.begin();
-         it != list.entries.end();) {
-      it->duplicateTarget = find(*it, list.entries) < it;
-
-      if (it->target.empty() || (!it->validTarget && flags[29]) ||
-          (it->duplicateTarget && flags[9])) {
-
-        it = list.entries.erase(it);
-
-        continue;
-      }
-
-      it->track = std::distance(list.entries.begin(), it) + 1;
+    index = Index();
 
-      if (it->localTarget) {
-        transformPath(it->playlist.parent_path(), it->target);
+    compactEntries(list.entries, [&](Entry &entry) {
+      entry.duplicateTarget = !entry.target.empty() && index.duplicate(entry);
 
-        it->validTarget = fs::exists(
-            absPath(list.playlist.parent_path(), processTarget(it->target)));
-      }
+      if (dropEntry(entry) || (entry.duplicateTarget && flags[9]))
+        return false;
 
-      if (!it->image.empty()) {
-        if (!it->validImage && flags[29]) {
-          it->image.clear();
-        } else if (it->localImage) {
-          transformPath(it->playlist.parent_path(), it->image);
-          it->validImage = fs::exists(
-              absPath(list.playlist.parent_path(), processTarget(it->image)));
-        }
-      }
+      index.insert(entry);
+      outEntry(entry);
 
-      it->playlist = list.playlist;
+      return true;
+    });
 
-      it++;
-    }
-
-    if (!list.image.empty()) {
-      if (!list.validImage && flags[29]) {
-        list.image.clear();
-      } else {
-        if (list.localImage) {
-          transformPath(list.playlist.parent_path(), list.image);
-          list.validImage = fs::exists(
-              absPath(list.playlist.parent_path(), processTarget(list.image)));
-        }
-      }
-    }
+    restatTargets(list.entries);
+    outImage();
 
     if (!base.empty() || flags[25])
       list.relative = (!base.empty() || flags[25]);
@@ -793,63 +1322,27 @@ int main(int argc, char **argv) {
                 << std::endl;
   }
 
-  if (list.entries.empty()) {
-    if ((cwar.rdbuf()->in_avail() != 0) && !flags[33])
-      std::cerr << cwar.rdbuf();
-    std::cerr << "Nothing to do!" << std::endl;
-
-    std::cout << "playlist -h for usage information" << std::endl;
-
-    return 2;
-  }
+  if (list.entries.empty())
+    return nothingToDo();
 
-  if (flags[1] || flags[2] || flags[3] || flags[4] || flags[5] || flags[6] ||
-      flags[7] || flags[8])
-    ::list(list);
+  const Columns columns(list.entries, listing);
 
-  for (const Entry &entry : list.entries) {
-    if (entry.duration > 0)
-      list.knownDuration += entry.duration;
+  if (listing)
+    ::list(list, columns);
 
-    list.dupeTargets += entry.duplicateTarget;
-    list.netTargets += !entry.localTarget;
-    list.unfoundTargets += !entry.validTarget;
-
-    if (!entry.image.empty()) {
-      list.netImages += !entry.localImage;
-      list.unfoundImages += !entry.validImage;
-    }
-  }
+  list.knownDuration += columns.knownDuration();
+  list.dupeTargets +=
+      Columns::count(columns.select({Columns::DuplicateTarget}));
+  list.netTargets += Columns::count(columns.select({}, {Columns::LocalTarget}));
+  list.unfoundTargets +=
+      Columns::count(columns.select({}, {Columns::ValidTarget}));
+  list.netImages += Columns::count(
+      columns.select({Columns::HasImage}, {Columns::LocalImage}));
+  list.unfoundImages += Columns::count(
+      columns.select({Columns::HasImage}, {Columns::ValidImage}));
 
   if (!list.playlist.empty()) {
-    if (list.unfoundTargets > 0)
-      cwar << "WARNING: out playlist has " << list.unfoundTargets
-           << " unfound entry target(s)" << std::endl;
-
-    if (!flags[18]) {
-      if (list.unfoundImages > 0)
-        cwar << "WARNING: out playlist has " << list.unfoundImages
-             << " unfound entry image(s)" << std::endl;
-
-      if (!list.image.empty() && !list.validImage)
-        cwar << "WARNING: out playlist image not found" << std::endl;
-
-      if (list.artists > 1)
-        cwar << "WARNING: 1 of " << list.artists
-             << " playlist artists auto-selected" << std::endl;
-
-      if (list.comments > 1)
-        cwar << "WARNING: 1 of " << list.comments
-             << " playlist comments auto-selected" << std::endl;
-
-      if (list.images > 1)
-        cwar << "WARNING: 1 of " << list.images
-             << " playlist images auto-selected" << std::endl;
-
-      if (list.titles > 1)
-        cwar << "WARNING: 1 of " << list.titles
-             << " playlist titles auto-selected" << std::endl;
-    }
+    outWarnings();
 
     if (flags[30]) {
       show(list);
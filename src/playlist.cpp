@@ -22,26 +22,53 @@
 #include "jspf.h"
 #include "m3u.h"
 #include "pls.h"
+#include "probe.h"
 #include "wpl.h"
 #include "xspf.h"
 
+#define HOST_CONNECTIONS 6
+#define HOST_FAILURES 3
+#define HOST_TIMEOUT_MIN 2000
+#define HOST_TIMEOUT_MAX 10000
+#define INTERN_BLOCK 65536
+#define INTERN_SHARDS 16
+
 #include <algorithm>
+#include <array>
+#include <atomic>
 #include <cctype>
+#include <cerrno>
+#include <charconv>
 #include <cmath>
+#include <cstring>
 #include <filesystem>
 #include <iomanip>
 #include <ios>
-#include <regex>
+#include <iterator>
 #include <sstream>
 #include <string>
+#include <thread>
+#include <unordered_set>
 #include <vector>
 
+#include <fcntl.h>
 #include <stdlib.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#ifdef __SSE2__
+#include <emmintrin.h>
+#endif
 
 #ifdef LIBCURL
 #include <curl/curl.h>
 #endif
 
+#ifdef LIBURING
+#include <liburing.h>
+#endif
+
 #ifdef TAGLIB
 #include <taglib/fileref.h>
 #include <taglib/taglib.h>
@@ -51,7 +78,17 @@
 namespace fs = std::filesystem;
 
 Flags flags;
-std::stringstream cwar;
+Resolver resolver;
+TargetCache targetCache;
+#ifdef TAGLIB
+MetadataCache metadataCache;
+#endif
+#ifdef LIBCURL
+Verifier verifier;
+#endif
+int connections = 16;
+int jobs = std::max(1U, std::thread::hardware_concurrency());
+thread_local std::stringstream cwar;
 std::string ver = "2.8";
 
 void show(const List &list) {
@@ -71,7 +108,7 @@ void show(const List &list) {
     std::string target = entry.localTarget ? entry.target.filename().string()
                                            : entry.target.string(),
                 title = (!entry.artist.empty() && !entry.title.empty())
-                            ? entry.artist + " - " + entry.title
+                            ? entry.artist.str() + " - " + entry.title
                             : entry.title,
                 status;
 
@@ -97,10 +134,11 @@ void show(const List &list) {
 
     if (entry.localTarget && entry.validTarget)
       size +=
-          fs::file_size(absPath(entry.playlist.parent_path(), entry.target));
+          fs::file_size(absPath(entry.playlist().parent_path(), entry.target));
 
     if (entry.localImage && entry.validImage)
-      size += fs::file_size(absPath(entry.playlist.parent_path(), entry.image));
+      size +=
+          fs::file_size(absPath(entry.playlist().parent_path(), entry.image));
 
     std::cout << entry.track << "\t" << status << "\t"
               << std::ceil(entry.duration / 1000) << "\t" << title << "\t"
@@ -160,139 +198,264 @@ void show(const List &list) {
     std::cout << std::endl;
 }
 
-void list(const List &list) {
-  std::vector<KeyValue> all, dupe, image, network, netImg, unfound, unfoundImg,
-      unique;
+// Entry field listed beside the target, chosen by the list key option.
+static const std::string listKey(const Entry &entry) {
+  if (flags[0])
+    return entry.artist.str();
 
-  const auto targetItem = [](const Entry &entry) {
-    if (flags[0])
-      return KeyValue(entry.artist, entry.target.string());
+  if (flags[10])
+    return entry.identifier;
 
-    if (flags[10])
-      return KeyValue(entry.identifier, entry.target.string());
+  if (flags[11])
+    return entry.comment;
 
-    if (flags[11])
-      return KeyValue(entry.comment, entry.target.string());
+  if (flags[12])
+    return entry.image.string();
 
-    if (flags[12])
-      return KeyValue(entry.image.string(), entry.target.string());
+  if (flags[15])
+    return entry.playlistTitle();
 
-    if (flags[15])
-      return KeyValue(entry.playlistTitle, entry.target.string());
+  if (flags[16])
+    return entry.playlistImage().string();
 
-    if (flags[16])
-      return KeyValue(entry.playlistImage.string(), entry.target.string());
+  if (flags[19])
+    return entry.album.str();
 
-    if (flags[19])
-      return KeyValue(entry.album, entry.target.string());
+  if (flags[21])
+    return entry.info;
 
-    if (flags[21])
-      return KeyValue(entry.info, entry.target.string());
+  if (flags[24])
+    return entry.playlist().string();
 
-    if (flags[24])
-      return KeyValue(entry.playlist.string(), entry.target.string());
+  if (flags[27])
+    return entry.playlistArtist();
 
-    if (flags[27])
-      return KeyValue(entry.playlistArtist, entry.target.string());
+  if (flags[28])
+    return entry.title;
 
-    if (flags[28])
-      return KeyValue(entry.title, entry.target.string());
+  if (flags[34])
+    return entry.playlistComment();
 
-    if (flags[34])
-      return KeyValue(entry.playlistComment, entry.target.string());
+  return std::to_string(entry.track);
+}
 
-    return KeyValue(std::to_string(entry.track), entry.target.string());
-  };
+void list(const List &list, const Columns &columns) {
+  Columns::Bits rows;
+  std::size_t listed = 0;
+  Index index;
+  bool status = false;
 
-  const auto listTargetItems = [](const std::vector<KeyValue> &items) {
-    for (const KeyValue &item : items) {
-      if (flags[17]) {
-        std::cout << item.second << std::endl;
-      } else {
-        std::cout << item.first << "\t" << item.second << std::endl;
-      }
+  if (flags[1]) {
+    rows = columns.select({});
+  } else if (flags[2]) {
+    rows = columns.select({Columns::DuplicateTarget});
+    status = !flags[33];
+  } else if (flags[3]) {
+    rows = columns.select({Columns::HasImage});
+  } else if (flags[4]) {
+    rows = columns.select({}, {Columns::LocalTarget});
+  } else if (flags[5]) {
+    rows = columns.select({Columns::HasImage}, {Columns::LocalImage});
+  } else if (flags[6]) {
+    rows = columns.select({}, {Columns::ValidTarget});
+    status = !flags[33];
+  } else if (flags[7]) {
+    rows = columns.select({Columns::HasImage}, {Columns::ValidImage});
+    status = !flags[33];
+  } else if (flags[8]) {
+    rows = columns.select({});
+
+    for (const Entry &entry : list.entries)
+      index.insert(entry);
+
+    for (std::size_t i = 0; i < list.entries.size(); i++)
+      if (!index.unique(list.entries[i]))
+        rows[i / 64] &= ~(1ULL << (i % 64));
+  }
+
+  Columns::each(rows, [&](std::size_t i) {
+    if (flags[17]) {
+      std::cout << columns.targets()[i] << std::endl;
+    } else {
+      std::cout << columns.keys()[i] << "\t" << columns.targets()[i]
+                << std::endl;
     }
-  };
 
-  for (Entries::const_iterator it = list.entries.begin();
-       it != list.entries.end(); it++) {
-    if (it->duplicateTarget)
-      dupe.push_back(targetItem(*it));
+    listed++;
+  });
 
-    if (!it->localTarget)
-      network.push_back(targetItem(*it));
+  std::exit(status && (listed > 0));
+}
 
-    if (!it->validTarget)
-      unfound.push_back(targetItem(*it));
+Columns::Columns(const Entries &entries, const bool text)
+    : m_size(entries.size()) {
+  for (Bits &bits : m_flags)
+    bits.assign((m_size + 63) / 64, 0);
 
-    if (find(*it, list.entries, false) == list.entries.end())
-      unique.push_back(targetItem(*it));
+  m_durations.reserve(m_size);
 
-    if (!it->image.empty()) {
-      if (!it->localImage)
-        netImg.push_back(targetItem(*it));
+  for (std::size_t i = 0; i < m_size; i++) {
+    const Entry &entry = entries[i];
+    const std::size_t word = i / 64, bit = i % 64;
 
-      if (!it->validImage)
-        unfoundImg.push_back(targetItem(*it));
+    m_flags[DuplicateTarget][word] |= std::uint64_t(entry.duplicateTarget)
+                                      << bit;
+    m_flags[HasImage][word] |= std::uint64_t(!entry.image.empty()) << bit;
+    m_flags[LocalImage][word] |= std::uint64_t(entry.localImage) << bit;
+    m_flags[LocalTarget][word] |= std::uint64_t(entry.localTarget) << bit;
+    m_flags[ValidImage][word] |= std::uint64_t(entry.validImage) << bit;
+    m_flags[ValidTarget][word] |= std::uint64_t(entry.validTarget) << bit;
+    m_durations.push_back(entry.duration);
 
-      image.push_back(targetItem(*it));
-    }
+    if (!text)
+      continue;
+
+    m_targets.push_back(entry.target.native());
 
-    all.push_back(targetItem(*it));
+    if (!flags[17])
+      m_keys.push_back(listKey(entry));
   }
+}
 
-  if (flags[1]) {
-    listTargetItems(all);
+const Columns::Bits Columns::select(std::initializer_list<Flag> set,
+                                    std::initializer_list<Flag> unset) const {
+  Bits bits((m_size + 63) / 64, ~0ULL);
 
-    std::exit(0);
-  } else if (flags[2]) {
-    listTargetItems(dupe);
+  for (std::size_t word = 0; word < bits.size(); word++) {
+    for (Flag flag : set)
+      bits[word] &= m_flags[flag][word];
 
-    std::exit(!flags[33] ? !dupe.empty() : 0);
-  } else if (flags[3]) {
-    listTargetItems(image);
+    for (Flag flag : unset)
+      bits[word] &= ~m_flags[flag][word];
+  }
 
-    std::exit(0);
-  } else if (flags[4]) {
-    listTargetItems(network);
+  if (m_size % 64)
+    bits.back() &= ~0ULL >> (64 - (m_size % 64));
 
-    std::exit(0);
-  } else if (flags[5]) {
-    listTargetItems(netImg);
+  return bits;
+}
 
-    std::exit(0);
-  } else if (flags[6]) {
-    listTargetItems(unfound);
+const int Columns::knownDuration() const {
+  int total = 0;
 
-    std::exit(!flags[33] ? !unfound.empty() : 0);
-  } else if (flags[7]) {
-    listTargetItems(unfoundImg);
+  for (int duration : m_durations)
+    total += std::max(duration, 0);
 
-    std::exit(!flags[33] ? !unfoundImg.empty() : 0);
-  } else if (flags[8]) {
-    listTargetItems(unique);
+  return total;
+}
+
+const std::size_t Columns::count(const Bits &bits) {
+  std::size_t total = 0;
+
+  for (std::uint64_t word : bits)
+    total += __builtin_popcountll(word);
+
+  return total;
+}
+
+void Columns::each(const Bits &bits,
+                   const std::function<void(std::size_t)> &visit) {
+  for (std::size_t word = 0; word < bits.size(); word++)
+    for (std::uint64_t w = bits[word]; w; w &= w - 1)
+      visit(word * 64 + __builtin_ctzll(w));
+}
+
+#ifdef TAGLIB
+
+// Cached metadata of a target, or that read from it. With a cache every field
+// is read, so that a later hit can serve any field set.
+static const MetadataCache::Record readMetadata(const fs::path &target,
+                                                const Fields &fields) {
+  MetadataCache::Record record;
+
+  if (metadataCache.find(target, record))
+    return record;
+
+  const Fields read = metadataCache.enabled() ? Fields().set() : fields;
+  TagLib::FileRef file = TagLib::FileRef(target.c_str(), read[FieldDuration]);
+
+  record.tagged = (!file.isNull() && !file.tag()->isEmpty());
+
+  if (record.tagged) {
+    if (read[FieldAlbum])
+      record.album = file.tag()->album().toCString();
+    if (read[FieldAlbumTrack])
+      record.albumTrack = file.tag()->track();
+    if (read[FieldArtist])
+      record.artist = file.tag()->artist().toCString();
+    if (read[FieldComment])
+      record.comment = file.tag()->comment().toCString();
+    if (read[FieldTitle])
+      record.title = file.tag()->title().toCString();
+  }
+
+  if (read[FieldDuration] && !file.isNull() && file.audioProperties())
+    record.duration = file.audioProperties()->lengthInMilliseconds();
+
+  metadataCache.insert(target, record);
+
+  return record;
+}
 
-    std::exit(0);
+const bool fetchMetadata(Entry &entry, const Fields &fields) {
+  const MetadataCache::Record record = readMetadata(
+      absPath(entry.playlist().parent_path(), entry.target), fields);
+
+  if (record.tagged) {
+    if (fields[FieldAlbum])
+      entry.album = record.album;
+    if (fields[FieldAlbumTrack])
+      entry.albumTrack = record.albumTrack;
+    if (fields[FieldArtist])
+      entry.artist = record.artist;
+    if (fields[FieldComment])
+      entry.comment = record.comment;
+    if (fields[FieldDuration] && (record.duration >= 0))
+      entry.duration = record.duration;
+    if (fields[FieldTitle])
+      entry.title = record.title;
   }
+
+  return record.tagged;
 }
+#endif
+
+const bool fetchDuration(Entry &entry) {
+  const fs::path target = absPath(entry.playlist().parent_path(), entry.target);
 #ifdef TAGLIB
 
-void fetchMetadata(Entry &entry) {
-  TagLib::FileRef file = TagLib::FileRef(
-      absPath(entry.playlist.parent_path(), entry.target).c_str());
+  // A cache holds durations read with the other fields.
+  if (metadataCache.enabled()) {
+    const MetadataCache::Record record =
+        readMetadata(target, Fields().set(FieldDuration));
+
+    if (record.duration >= 0)
+      entry.duration = record.duration;
+
+    return (record.duration >= 0);
+  }
+
+#endif
+  const int duration = Probe(target).duration();
 
-  if (!file.isNull() && !file.tag()->isEmpty()) {
-    entry.album = file.tag()->album().toCString();
-    entry.albumTrack = file.tag()->track();
-    entry.artist = file.tag()->artist().toCString();
-    entry.comment = file.tag()->comment().toCString();
+  if (duration >= 0) {
+    entry.duration = duration;
+
+    return true;
+  }
+
+#ifdef TAGLIB
+  TagLib::FileRef file = TagLib::FileRef(target.c_str());
+
+  if (!file.isNull() && file.audioProperties()) {
     entry.duration = file.audioProperties()->lengthInMilliseconds();
-    entry.title = file.tag()->title().toCString();
-  } else {
-    cwar << "Could not read target tag: " << entry.target << std::endl;
+
+    return true;
   }
-}
+
 #endif
+  return false;
+}
 
 const std::string processTarget(std::string target) {
   if (target.find("%") != std::string::npos)
@@ -314,46 +477,149 @@ const std::string processTarget(std::string target) {
   return target;
 }
 
-const std::string unquote(std::string str) {
-  std::istringstream unquote(str);
-  unquote >> std::quoted(str);
+const std::string unquote(std::string_view str) {
+  static const char *space = " \t\n\v\f\r";
+  const std::size_t begin = str.find_first_not_of(space);
+  std::string unquoted;
+
+  // Read as std::quoted does: a quoted string with backslash escapes, else
+  // the first word. Blank input is returned unchanged.
+  if (begin == std::string_view::npos)
+    return std::string(str);
+
+  str.remove_prefix(begin);
+
+  if (str.front() != '"')
+    return std::string(str.substr(0, str.find_first_of(space)));
+
+  for (std::size_t i = 1; (i < str.size()) && (str[i] != '"'); i++) {
+    if ((str[i] == '\\') && (++i == str.size()))
+      break;
 
-  return str;
+    unquoted += str[i];
+  }
+
+  return unquoted;
 }
 
-const std::string percentEncode(const std::string &uri) {
-  std::ostringstream uriOut;
-  std::regex r("[!:\\/\\-._~0-9A-Za-z]");
+/**
+ * Bytes left as is by percentEncode.
+ */
+static const std::array<bool, 256> uriSafe = [] {
+  std::array<bool, 256> table{};
+
+  for (const unsigned char c : std::string_view("!-./:_~"))
+    table[c] = true;
+  for (int c = '0'; c <= '9'; c++)
+    table[c] = true;
+  for (int c = 'A'; c <= 'Z'; c++)
+    table[c] = true;
+  for (int c = 'a'; c <= 'z'; c++)
+    table[c] = true;
+
+  return table;
+}();
+
+/**
+ * Values of the upper case hex digits decoded by percentDecode, or -1.
+ */
+static const std::array<signed char, 256> uriHex = [] {
+  std::array<signed char, 256> table;
 
-  for (const char &c : uri) {
-    if (std::regex_match(std::string({c}), r)) {
-      uriOut << c;
-    } else {
-      uriOut << "%" << std::uppercase << std::hex << (0xff & c);
-    }
+  table.fill(-1);
+
+  for (int c = '0'; c <= '9'; c++)
+    table[c] = c - '0';
+  for (int c = 'A'; c <= 'F'; c++)
+    table[c] = c - 'A' + 10;
+
+  return table;
+}();
+
+/**
+ * Length of the run of bytes at the start of str that need no escaping.
+ */
+static const std::size_t uriSafeSpan(const char *str, std::size_t size) {
+  std::size_t i = 0;
+
+#ifdef __SSE2__
+  // Safe bytes are '!', '-' to ':', 'A' to 'Z', '_', 'a' to 'z' and '~'.
+  // Bytes from 0x80 compare as negative and so fall outside every range.
+  const auto range = [](__m128i v, char low, char high) {
+    return _mm_and_si128(_mm_cmpgt_epi8(v, _mm_set1_epi8(low - 1)),
+                         _mm_cmplt_epi8(v, _mm_set1_epi8(high + 1)));
+  };
+
+  for (; i + 16 <= size; i += 16) {
+    const __m128i v = _mm_loadu_si128((const __m128i *)(str + i));
+    const __m128i safe = _mm_or_si128(
+        _mm_or_si128(_mm_or_si128(range(v, '-', ':'), range(v, 'A', 'Z')),
+                     _mm_or_si128(range(v, 'a', 'z'),
+                                  _mm_cmpeq_epi8(v, _mm_set1_epi8('!')))),
+        _mm_or_si128(_mm_cmpeq_epi8(v, _mm_set1_epi8('_')),
+                     _mm_cmpeq_epi8(v, _mm_set1_epi8('~'))));
+    const int mask = _mm_movemask_epi8(safe);
+
+    if (mask != 0xFFFF)
+      return i + __builtin_ctz(~mask);
   }
+#endif
 
-  return uriOut.str();
+  while ((i < size) && uriSafe[(unsigned char)str[i]])
+    i++;
+
+  return i;
 }
 
-const std::string percentDecode(std::string uri) {
-  int len = uri.size() - 2;
+const std::string percentEncode(const std::string &uri) {
+  static const char *hex = "0123456789ABCDEF";
+  std::string uriOut;
+  std::size_t i = 0;
+
+  uriOut.reserve(uri.size());
 
-  for (int i = 0; i < len; i++) {
-    std::smatch match;
-    std::string buf = uri.substr(i, 3);
+  while (i < uri.size()) {
+    const std::size_t span = uriSafeSpan(uri.data() + i, uri.size() - i);
 
-    if (std::regex_match(buf, match, std::regex("%[0-9A-F]{2}"))) {
-      std::string c;
+    uriOut.append(uri, i, span);
+    i += span;
 
-      buf = buf.replace(0, 1, "0x");
-      c = (char)std::stoi(buf, nullptr, 16);
-      uri = uri.replace(uri.begin() + i, uri.begin() + i + 3, c);
+    if (i < uri.size()) {
+      const unsigned char c = uri[i++];
+
+      uriOut += '%';
+      uriOut += hex[c >> 4];
+      uriOut += hex[c & 0xF];
     }
+  }
+
+  return uriOut;
+}
 
-    len = uri.size() - 2;
+const std::string percentDecode(std::string uri) {
+  const char *begin = uri.data(), *end = begin + uri.size(), *in = begin;
+  char *out = uri.data();
+
+  // Decoding only shrinks, so the string is rewritten in place.
+  while (const char *escape =
+             static_cast<const char *>(std::memchr(in, '%', end - in))) {
+    std::memmove(out, in, escape - in);
+    out += escape - in;
+    in = escape + 1;
+
+    if ((end - escape >= 3) && (uriHex[(unsigned char)escape[1]] >= 0) &&
+        (uriHex[(unsigned char)escape[2]] >= 0)) {
+      *out++ = (uriHex[(unsigned char)escape[1]] << 4) |
+               uriHex[(unsigned char)escape[2]];
+      in += 2;
+    } else {
+      *out++ = '%';
+    }
   }
 
+  std::memmove(out, in, end - in);
+  uri.resize(out + (end - in) - uri.data());
+
   return uri;
 }
 
@@ -385,54 +651,933 @@ const KeyValue split(const std::string &line, std::string delim) {
   return KeyValue(line.substr(0, pos), line.substr(pos + 1));
 }
 
+const int toInt(std::string_view str) {
+  int value = 0;
+
+  while (!str.empty() && std::isspace((unsigned char)str.front()))
+    str.remove_prefix(1);
+
+  if ((str.size() > 1) && (str.front() == '+') && (str.at(1) != '-'))
+    str.remove_prefix(1);
+
+  std::from_chars(str.data(), str.data() + str.size(), value);
+
+  return value;
+}
+
 const bool isUri(const std::string &target) {
   return (target.find("://") != std::string::npos);
 }
 
 const bool validTarget(const fs::path &target) {
   const bool local = !isUri(target.string());
-  bool valid = (!local || fs::exists(target));
+  bool valid;
+
+  if ((local || flags[26]) && targetCache.find(target, valid))
+    return valid;
+
+  valid = (!local || resolver.exists(target));
 
 #ifdef LIBCURL
   if (!local && flags[26]) {
-    CURL *curl = curl_easy_init();
-    CURLcode result;
+    verifier.add(target.string(), &valid);
+    verifier.run();
+
+    return valid;
+  }
+#endif
+  if (local || flags[26])
+    targetCache.insert(target, valid);
+
+  return valid;
+}
+
+void validTargets(const Targets &targets) {
+  Targets local;
+
+  for (const std::pair<fs::path, bool *> &target : targets) {
+    if (!isUri(target.first.string())) {
+      local.push_back(target);
+
+      continue;
+    }
+#ifdef LIBCURL
+
+    if (flags[26]) {
+      if (!targetCache.find(target.first, *target.second))
+        verifier.add(target.first.string(), target.second);
+
+      continue;
+    }
+#endif
+    *target.second = validTarget(target.first);
+  }
+
+  statTargets(local);
+#ifdef LIBCURL
+  verifier.run();
+#endif
+}
+
+void statTargets(const Targets &targets) {
+  std::vector<const std::pair<fs::path, bool *> *> pending;
+  std::vector<int> status;
+  bool stated(false);
+
+  for (const std::pair<fs::path, bool *> &target : targets) {
+    if (targetCache.find(target.first, *target.second))
+      continue;
+
+    if (target.first.is_absolute() && target.first.has_filename() &&
+        (resolver.modified(target.first) < 0)) {
+      *target.second = false;
+      targetCache.insert(target.first, false);
+
+      continue;
+    }
+
+    pending.push_back(&target);
+  }
+
+  status.resize(pending.size(), -1);
+#ifdef LIBURING
+
+  std::vector<struct statx> stx(pending.size());
+  struct io_uring ring;
+
+  if (!pending.empty() && !io_uring_queue_init(256, &ring, 0)) {
+    std::size_t submitted(0), completed(0);
+
+    stated = true;
+
+    while (completed < pending.size()) {
+      struct io_uring_cqe *cqe;
+
+      for (; submitted < pending.size(); submitted++) {
+        struct io_uring_sqe *sqe = io_uring_get_sqe(&ring);
+
+        if (!sqe)
+          break;
+
+        io_uring_prep_statx(sqe, AT_FDCWD, pending[submitted]->first.c_str(),
+                            0, STATX_TYPE, &stx[submitted]);
+        io_uring_sqe_set_data(sqe, (void *)submitted);
+      }
+
+      io_uring_submit_and_wait(&ring, 1);
+
+      while (!io_uring_peek_cqe(&ring, &cqe)) {
+        const std::size_t i = (std::size_t)io_uring_cqe_get_data(cqe);
+
+        status[i] = cqe->res;
+
+        if ((cqe->res == -EINVAL) || (cqe->res == -EOPNOTSUPP))
+          stated = false;
+
+        io_uring_cqe_seen(&ring, cqe);
+        completed++;
+      }
+    }
+
+    io_uring_queue_exit(&ring);
+  }
+#endif
+
+  if (!stated)
+    parallel(pending.size(), [&](std::size_t i) {
+      struct stat st;
+
+      status[i] = stat(pending[i]->first.c_str(), &st);
+    });
+
+  for (std::size_t i = 0; i < pending.size(); i++) {
+    *pending[i]->second = !status[i];
+
+    targetCache.insert(pending[i]->first, *pending[i]->second);
+  }
+}
+
+void parallel(std::size_t count, const std::function<void(std::size_t)> &task) {
+  std::atomic<std::size_t> next(0);
+  std::vector<std::thread> threads;
+
+  const auto work = [&]() {
+    for (std::size_t i = next++; i < count; i = next++)
+      task(i);
+  };
+
+  for (std::size_t t = 1; t < std::min<std::size_t>(jobs, count); t++)
+    threads.emplace_back(work);
+
+  work();
+
+  for (std::thread &thread : threads)
+    thread.join();
+}
+
+void spliceEntries(Entries &entries, Entries &from) {
+  if (entries.empty() && (entries.capacity() < from.size())) {
+    entries.swap(from);
+  } else {
+    entries.insert(entries.end(), std::make_move_iterator(from.begin()),
+                   std::make_move_iterator(from.end()));
+  }
+
+  Entries().swap(from);
+}
+
+void moveEntry(Entries &entries, std::size_t from, std::size_t to) {
+  const Entries::iterator f = entries.begin() + from, t = entries.begin() + to;
+
+  if (f < t) {
+    std::rotate(f, f + 1, t + 1);
+  } else {
+    std::rotate(t, f, f + 1);
+  }
+}
+
+void compactEntries(Entries &entries,
+                    const std::function<bool(Entry &)> &keep) {
+  Entries::iterator kept = entries.begin();
+
+  for (Entries::iterator it = entries.begin(); it != entries.end(); it++) {
+    if (!keep(*it))
+      continue;
+
+    it->track = std::distance(entries.begin(), kept) + 1;
+
+    if (kept != it)
+      *kept = std::move(*it);
+
+    kept++;
+  }
+
+  entries.erase(kept, entries.end());
+}
+
+#ifdef TAGLIB
+
+void MetadataCache::load(const fs::path &file) {
+  std::ifstream cache(file);
+  std::string album, artist, key;
+  Record record;
+
+  m_file = file;
+
+  while (cache >> key >> record.size >> record.modified >> record.tagged >>
+         record.albumTrack >> record.duration >> std::quoted(record.target) >>
+         std::quoted(album) >> std::quoted(artist) >>
+         std::quoted(record.comment) >> std::quoted(record.title)) {
+    record.album = album;
+    record.artist = artist;
+    m_records[key] = record;
+  }
+}
+
+const bool MetadataCache::save() {
+  fs::path tmp = m_file;
+  std::ofstream cache;
+
+  if (m_file.empty() || !m_changed)
+    return true;
+
+  tmp += ".tmp";
+  cache.open(tmp);
+
+  for (const std::pair<const std::string, Record> &record : m_records)
+    cache << record.first << "\t" << record.second.size << "\t"
+          << record.second.modified << "\t" << record.second.tagged << "\t"
+          << record.second.albumTrack << "\t" << record.second.duration
+          << "\t" << std::quoted(record.second.target) << "\t"
+          << std::quoted(record.second.album.view()) << "\t"
+          << std::quoted(record.second.artist.view()) << "\t"
+          << std::quoted(record.second.comment) << "\t"
+          << std::quoted(record.second.title) << std::endl;
+
+  cache.close();
+
+  if (cache.fail())
+    return false;
+
+  fs::rename(tmp, m_file);
+  m_changed = false;
+
+  return true;
+}
+
+const bool MetadataCache::find(const fs::path &target, Record &record) {
+  std::string k;
+  Record current;
+
+  if (m_file.empty() || !key(target, k, current))
+    return false;
+
+  std::lock_guard<std::mutex> lock(m_mutex);
+  const auto it = m_records.find(k);
+
+  if ((it == m_records.end()) || (it->second.size != current.size) ||
+      (it->second.modified != current.modified))
+    return false;
+
+  record = it->second;
+
+  return true;
+}
+
+void MetadataCache::insert(const fs::path &target, const Record &record) {
+  std::string k;
+  Record current;
+
+  if (m_file.empty() || !key(target, k, current))
+    return;
+
+  current.target = target.string();
+  current.album = record.album;
+  current.albumTrack = record.albumTrack;
+  current.artist = record.artist;
+  current.comment = record.comment;
+  current.duration = record.duration;
+  current.tagged = record.tagged;
+  current.title = record.title;
+
+  std::lock_guard<std::mutex> lock(m_mutex);
+
+  m_records[k] = current;
+  m_changed = true;
+}
+
+void MetadataCache::compact() {
+  for (auto it = m_records.begin(); it != m_records.end();) {
+    std::string k;
+    Record current;
+
+    if (!key(it->second.target, k, current) || (k != it->first) ||
+        (current.size != it->second.size) ||
+        (current.modified != it->second.modified)) {
+      it = m_records.erase(it);
+      m_changed = true;
+
+      continue;
+    }
+
+    it++;
+  }
+}
+
+const bool MetadataCache::key(const fs::path &target, std::string &key,
+                              Record &record) {
+  struct stat st;
+
+  if (stat(target.c_str(), &st))
+    return false;
 
-    curl_easy_setopt(curl, CURLOPT_URL, target.c_str());
-    curl_easy_setopt(curl, CURLOPT_USERAGENT,
-                     std::string("playlist/" + ver).c_str());
-    curl_easy_setopt(curl, CURLOPT_NOBODY, true);
-    curl_easy_setopt(curl, CURLOPT_FAILONERROR, true);
-    curl_easy_setopt(curl, CURLOPT_TIMEOUT, 10);
+  key = std::to_string(st.st_dev) + ":" + std::to_string(st.st_ino);
+  record.modified = st.st_mtime;
+  record.size = st.st_size;
 
-    result = curl_easy_perform(curl);
+  return true;
+}
+#endif
+
+#ifdef LIBCURL
+
+void Verifier::add(const std::string &target, bool *valid) {
+  Target &t = m_targets[target];
+
+  if (t.valid.empty()) {
+    CURLU *url = curl_url();
+    char *host(nullptr), *port(nullptr);
+    std::string name = target;
+
+    if (!curl_url_set(url, CURLUPART_URL, target.c_str(), 0) &&
+        !curl_url_get(url, CURLUPART_HOST, &host, 0) &&
+        !curl_url_get(url, CURLUPART_PORT, &port, CURLU_DEFAULT_PORT))
+      name = std::string(host) + ":" + port;
+
+    curl_free(host);
+    curl_free(port);
+    curl_url_cleanup(url);
+
+    if (!m_hosts.count(name))
+      m_order.push_back(name);
+
+    t.host = &m_hosts[name];
+    t.host->pending.push_back(target);
+  }
+
+  t.valid.push_back(valid);
+}
+
+Verifier::~Verifier() {
+  for (CURL *curl : m_handles)
     curl_easy_cleanup(curl);
 
-    valid = (result == CURLE_OK);
+  if (m_multi) {
+    curl_multi_cleanup(m_multi);
+    curl_share_cleanup(m_share);
+    curl_global_cleanup();
+  }
+}
+
+void Verifier::run() {
+  const std::string userAgent = "playlist/" + ver;
+  CURLMsg *msg;
+  int active(0), running(0), queued(0);
+
+  if (m_targets.empty())
+    return;
+
+  if (!m_multi) {
+    curl_global_init(CURL_GLOBAL_DEFAULT);
+
+    m_share = curl_share_init();
+    curl_share_setopt(m_share, CURLSHOPT_SHARE, CURL_LOCK_DATA_DNS);
+    curl_share_setopt(m_share, CURLSHOPT_SHARE, CURL_LOCK_DATA_CONNECT);
+    curl_share_setopt(m_share, CURLSHOPT_SHARE, CURL_LOCK_DATA_SSL_SESSION);
+
+    m_multi = curl_multi_init();
+    curl_multi_setopt(m_multi, CURLMOPT_PIPELINING, CURLPIPE_MULTIPLEX);
+  }
+
+  const auto start = [&](Host &host) {
+    CURL *curl = handle();
+    long timeout = HOST_TIMEOUT_MAX;
+
+    if (host.latency > 0)
+      timeout = std::clamp((long)(host.latency * 8000), (long)HOST_TIMEOUT_MIN,
+                           (long)HOST_TIMEOUT_MAX);
+
+    curl_easy_setopt(curl, CURLOPT_URL, host.pending.front().c_str());
+    curl_easy_setopt(curl, CURLOPT_USERAGENT, userAgent.c_str());
+    curl_easy_setopt(curl, CURLOPT_TIMEOUT_MS, timeout);
+    curl_easy_setopt(curl, CURLOPT_PRIVATE,
+                     &*m_targets.find(host.pending.front()));
+
+    curl_multi_add_handle(m_multi, curl);
+
+    host.pending.pop_front();
+    host.active++;
+    active++;
+  };
+
+  const auto finish = [&](CURL *curl, CURLcode result) {
+    std::pair<const std::string, Target> *target;
+    double time;
+
+    curl_easy_getinfo(curl, CURLINFO_PRIVATE, &target);
+    curl_easy_getinfo(curl, CURLINFO_TOTAL_TIME, &time);
+
+    Host &host = *target->second.host;
+
+    if ((result == CURLE_COULDNT_RESOLVE_HOST) ||
+        (result == CURLE_COULDNT_CONNECT) ||
+        (result == CURLE_OPERATION_TIMEDOUT)) {
+      host.failures++;
+      host.limit = std::max(1, host.limit / 2);
+      host.broken = (!host.responded || (host.failures >= HOST_FAILURES));
+    } else {
+      host.failures = 0;
+      host.latency = (host.latency > 0) ? (0.8 * host.latency + 0.2 * time)
+                                        : time;
+      host.limit = std::min(HOST_CONNECTIONS, host.limit + 1);
+      host.responded = true;
+    }
+
+    for (bool *valid : target->second.valid)
+      *valid = (result == CURLE_OK);
+
+    targetCache.insert(target->first, result == CURLE_OK);
+
+    host.active--;
+    active--;
+  };
+
+  while (true) {
+    bool started(true);
+
+    while (started && (active < connections)) {
+      started = false;
+
+      for (const std::string &name : m_order) {
+        Host &host = m_hosts[name];
+
+        if (host.broken) {
+          for (const std::string &target : host.pending)
+            for (bool *valid : m_targets[target].valid)
+              *valid = false;
+
+          host.pending.clear();
+        }
+
+        if (host.pending.empty() || (host.active >= host.limit))
+          continue;
+
+        if (active >= connections)
+          break;
+
+        start(host);
+        started = true;
+      }
+    }
+
+    if (active == 0)
+      break;
+
+    curl_multi_perform(m_multi, &running);
+
+    while ((msg = curl_multi_info_read(m_multi, &queued))) {
+      CURL *curl = msg->easy_handle;
+
+      if (msg->msg != CURLMSG_DONE)
+        continue;
+
+      finish(curl, msg->data.result);
+
+      curl_multi_remove_handle(m_multi, curl);
+      m_handles.push_back(curl);
+    }
+
+    if (running > 0)
+      curl_multi_poll(m_multi, nullptr, 0, 1000, nullptr);
   }
+
+  m_targets.clear();
+}
+
+CURL *Verifier::handle() {
+  CURL *curl;
+
+  if (!m_handles.empty()) {
+    curl = m_handles.back();
+    m_handles.pop_back();
+
+    return curl;
+  }
+
+  curl = curl_easy_init();
+
+  curl_easy_setopt(curl, CURLOPT_SHARE, m_share);
+  curl_easy_setopt(curl, CURLOPT_NOBODY, true);
+  curl_easy_setopt(curl, CURLOPT_FAILONERROR, true);
+  curl_easy_setopt(curl, CURLOPT_HTTP_VERSION, CURL_HTTP_VERSION_2TLS);
+  curl_easy_setopt(curl, CURLOPT_PIPEWAIT, true);
+  curl_easy_setopt(curl, CURLOPT_TCP_KEEPALIVE, true);
+
+  return curl;
+}
 #endif
-  return valid;
+
+MappedFile::MappedFile(const fs::path &file) {
+  struct stat st;
+  const int fd = open(file.c_str(), O_RDONLY | O_CLOEXEC);
+
+  if ((fd < 0) || fstat(fd, &st)) {
+    m_bad = true;
+  } else if (S_ISREG(st.st_mode) && (st.st_size % sysconf(_SC_PAGESIZE))) {
+    // The rest of the last page reads as zero, terminating the contents.
+    void *data = mmap(nullptr, st.st_size, PROT_READ | PROT_WRITE,
+                      MAP_PRIVATE | MAP_POPULATE, fd, 0);
+
+    if (data != MAP_FAILED) {
+      m_data = static_cast<char *>(data);
+      m_size = st.st_size;
+      m_mapped = true;
+    }
+  }
+
+  if (!m_bad && !m_mapped) {
+    ssize_t size;
+
+    do {
+      m_buffer.resize(m_size + (1 << 16));
+
+      while (((size = read(fd, m_buffer.data() + m_size,
+                           m_buffer.size() - m_size)) < 0) &&
+             (errno == EINTR))
+        ;
+
+      m_size += std::max<ssize_t>(size, 0);
+    } while (size > 0);
+
+    m_bad = (size < 0);
+    m_buffer.resize(m_size + 1);
+    m_buffer[m_size] = '\0';
+    m_data = m_buffer.data();
+  }
+
+  if (fd >= 0)
+    close(fd);
 }
 
-const Entries::const_iterator find(const Entry &entry, const Entries &entries,
-                                   bool sameList) {
-  return std::find_if(entries.begin(), entries.end(), [&](const Entry &e) {
-    if (!sameList && (entry.playlist == e.playlist))
-      return false;
+MappedFile::~MappedFile() {
+  if (m_mapped)
+    munmap(m_data, m_size);
+}
+
+LineReader::LineReader(const fs::path &file) {
+  struct stat st;
+
+  if (!stat(file.c_str(), &st) && S_ISREG(st.st_mode)) {
+    m_map = std::make_unique<MappedFile>(file);
+    m_bad = m_map->bad();
+    m_pos = m_map->data();
+    m_end = m_pos + m_map->size();
+  } else {
+    m_fd = open(file.c_str(), O_RDONLY | O_CLOEXEC);
+    m_bad = (m_fd < 0);
+  }
+
+  m_eof = m_bad;
+}
+
+LineReader::~LineReader() {
+  if (m_fd >= 0)
+    close(m_fd);
+}
+
+const bool LineReader::getline(std::string_view &line) {
+  if (m_eof)
+    return false;
+
+  for (;;) {
+    const char *end = m_pos ? static_cast<const char *>(
+                                  std::memchr(m_pos, '\n', m_end - m_pos))
+                            : nullptr;
+
+    if (end) {
+      line = std::string_view(m_pos, end - m_pos);
+      m_pos = end + 1;
 
-    if (fs::weakly_canonical(
-            absPath(entry.playlist.parent_path(), entry.target).string()) ==
-        fs::weakly_canonical(
-            absPath(e.playlist.parent_path(), e.target).string()))
       return true;
+    }
+
+    if ((m_fd < 0) || !fill())
+      break;
+  }
+
+  line = std::string_view(m_pos, m_end - m_pos);
+  m_pos = m_end;
+  m_eof = true;
+
+  return true;
+}
+
+const bool LineReader::fill() {
+  const std::size_t unread = m_end - m_pos;
+  ssize_t size;
+
+  if (unread && (m_pos != m_buffer.data()))
+    std::memmove(m_buffer.data(), m_pos, unread);
+
+  m_buffer.resize(std::max<std::size_t>(m_buffer.size(), unread + (1 << 20)));
+
+  while (((size = read(m_fd, m_buffer.data() + unread,
+                       m_buffer.size() - unread)) < 0) &&
+         (errno == EINTR))
+    ;
+
+  m_bad = (size < 0);
+  m_pos = m_buffer.data();
+  m_end = m_pos + unread + std::max<ssize_t>(size, 0);
+
+  return (size > 0);
+}
+
+const std::string_view *Interned::intern(std::string_view value) {
+  struct Shard {
+    std::mutex mutex;
+    std::unordered_set<std::string_view> values;
+    std::vector<std::unique_ptr<char[]>> blocks;
+    char *block = nullptr;
+    std::size_t used = INTERN_BLOCK;
+  };
+  // Never freed, as handles are still read by the cache savers run at exit.
+  static Shard *const shards = new Shard[INTERN_SHARDS];
+
+  if (value.empty())
+    return &none;
+
+  Shard &shard = shards[std::hash<std::string_view>()(value) % INTERN_SHARDS];
+  std::lock_guard<std::mutex> lock(shard.mutex);
+  const auto found = shard.values.find(value);
+  char *data;
+
+  if (found != shard.values.end())
+    return &*found;
+
+  // Values are copied NUL terminated into blocks that are never freed or
+  // moved, so handles stay valid for the life of the process.
+  if (value.size() >= INTERN_BLOCK / 4) {
+    shard.blocks.emplace_back(new char[value.size() + 1]);
+    data = shard.blocks.back().get();
+  } else {
+    if (shard.used + value.size() + 1 > INTERN_BLOCK) {
+      shard.blocks.emplace_back(new char[INTERN_BLOCK]);
+      shard.block = shard.blocks.back().get();
+      shard.used = 0;
+    }
+
+    data = shard.block + shard.used;
+    shard.used += value.size() + 1;
+  }
 
-    if (!entry.artist.empty() && !entry.title.empty())
-      if ((entry.artist == e.artist) && (entry.title == e.title))
-        return true;
+  std::memcpy(data, value.data(), value.size());
+  data[value.size()] = '\0';
+
+  return &*shard.values.emplace(data, value.size()).first;
+}
+
+std::ostream &operator<<(std::ostream &os, const Interned &value) {
+  return os << value.view();
+}
 
+void Entry::setPlaylist(const fs::path &playlist) {
+  Headers moved;
+
+  setPlaylist(playlist, moved);
+}
+
+void Entry::setPlaylist(const fs::path &playlist, Headers &moved) {
+  if (header && (header->playlist == playlist))
+    return;
+
+  std::shared_ptr<const Header> &to = moved[header];
+
+  if (!to || (to->playlist != playlist)) {
+    std::shared_ptr<Header> copy =
+        header ? std::make_shared<Header>(*header) : std::make_shared<Header>();
+
+    copy->playlist = playlist;
+    to = copy;
+  }
+
+  header = to;
+}
+
+const bool Index::duplicate(const Entry &entry) const {
+  const std::string track = trackKey(entry);
+
+  if (m_targets.count(targetKey(entry)))
+    return true;
+
+  return (!track.empty() && m_tracks.count(track));
+}
+
+const bool Index::unique(const Entry &entry) const {
+  const auto shared = [&](const std::unordered_map<std::string, Source> &keys,
+                          const std::string &key) {
+    const auto it = keys.find(key);
+
+    if (it == keys.end())
+      return false;
+
+    return (it->second.shared || (it->second.playlist != entry.playlist()));
+  };
+  const std::string track = trackKey(entry);
+
+  if (shared(m_targets, targetKey(entry)))
     return false;
-  });
-};
+
+  return (track.empty() || !shared(m_tracks, track));
+}
+
+void Index::insert(const Entry &entry) {
+  const auto add = [&](std::unordered_map<std::string, Source> &keys,
+                       const std::string &key) {
+    const auto it = keys.find(key);
+
+    if (it == keys.end()) {
+      keys.emplace(key, Source{entry.playlist()});
+    } else if (it->second.playlist != entry.playlist()) {
+      it->second.shared = true;
+    }
+  };
+  const std::string track = trackKey(entry);
+
+  add(m_targets, targetKey(entry));
+
+  if (!track.empty())
+    add(m_tracks, track);
+}
+
+const std::string Index::targetKey(const Entry &entry) {
+  return resolver
+      .canonical(absPath(entry.playlist().parent_path(), entry.target))
+      .string();
+}
+
+const std::string Index::trackKey(const Entry &entry) {
+  const void *artist = entry.artist.id();
+
+  if (entry.artist.empty() || entry.title.empty())
+    return std::string();
+
+  // Interned artists compare by identity, so key on the handle, not the text.
+  return std::string((const char *)&artist, sizeof(artist)) + entry.title;
+}
+
+const fs::path Resolver::canonical(const fs::path &path) {
+  const fs::path filename = path.filename();
+
+  if (!path.is_absolute() || filename.empty() || (filename == ".") ||
+      (filename == ".."))
+    return fs::weakly_canonical(path);
+
+  const Directory &dir = directory(path.parent_path());
+
+  if (dir.exists && fs::is_symlink(fs::symlink_status(path)))
+    return fs::weakly_canonical(path);
+
+  return dir.canonical / filename;
+}
+
+const bool Resolver::exists(const fs::path &path) {
+  if (!path.is_absolute() || !path.has_filename())
+    return fs::exists(path);
+
+  return (directory(path.parent_path()).exists && fs::exists(path));
+}
+
+const time_t Resolver::modified(const fs::path &path) {
+  return directory(path.parent_path()).modified;
+}
+
+const Resolver::Directory &Resolver::directory(const fs::path &path) {
+  auto it = m_directories.find(path.string());
+
+  if (it == m_directories.end()) {
+    struct stat st;
+    Directory dir;
+
+    dir.exists = (!stat(path.c_str(), &st) && S_ISDIR(st.st_mode));
+    dir.canonical = fs::weakly_canonical(path);
+
+    if (dir.exists)
+      dir.modified = st.st_mtime;
+
+    it = m_directories.emplace(path.string(), dir).first;
+  }
+
+  return it->second;
+}
+
+void TargetCache::load(const fs::path &file) {
+  std::ifstream cache(file);
+  std::string line;
+
+  m_file = file;
+
+  while (std::getline(cache, line)) {
+    std::istringstream fields(line);
+    std::string target;
+    Record record;
+
+    fields >> record.valid >> record.checked;
+
+    if (fields.get() != '\t' || !std::getline(fields, target) || target.empty())
+      continue;
+
+    m_records[target] = record;
+  }
+}
+
+const bool TargetCache::save() {
+  const time_t now = std::time(nullptr);
+  fs::path tmp = m_file;
+  std::ofstream cache;
+
+  if (m_file.empty() || !m_changed)
+    return true;
+
+  tmp += ".tmp";
+  cache.open(tmp);
+
+  for (const std::pair<const std::string, Record> &record : m_records) {
+    if (isUri(record.first) && ((now - record.second.checked) >= ttl))
+      continue;
+
+    cache << record.second.valid << "\t" << record.second.checked << "\t"
+          << record.first << std::endl;
+  }
+
+  cache.close();
+
+  if (cache.fail())
+    return false;
+
+  fs::rename(tmp, m_file);
+  m_changed = false;
+
+  return true;
+}
+
+const bool TargetCache::find(const fs::path &target, bool &valid) {
+  const auto it = m_records.find(target.string());
+
+  if (m_file.empty() || (it == m_records.end()))
+    return false;
+
+  if (isUri(target.string())) {
+    if ((std::time(nullptr) - it->second.checked) >= ttl)
+      return false;
+  } else {
+    const time_t modified = resolver.modified(target);
+
+    if ((modified < 0) || (modified >= it->second.checked))
+      return false;
+  }
+
+  valid = it->second.valid;
+
+  return true;
+}
+
+void TargetCache::insert(const fs::path &target, bool valid) {
+  if (m_file.empty())
+    return;
+
+  Record &record = m_records[target.string()];
+
+  record.checked = std::time(nullptr);
+  record.valid = valid;
+
+  m_changed = true;
+}
+
+const fs::path &Playlist::writePath() {
+  m_writePath = m_playlist;
+
+  if (!fs::exists(m_playlist) || fs::is_regular_file(m_playlist))
+    m_writePath += ".tmp";
+
+  return m_writePath;
+}
+
+const bool Playlist::writeCommit(const bool written) {
+  std::error_code ec;
+  bool committed = written;
+
+  if (m_writePath.empty() || (m_writePath == m_playlist)) {
+    m_writePath.clear();
+
+    return committed;
+  }
+
+  if (written) {
+    if (fs::exists(m_playlist))
+      fs::permissions(m_writePath, fs::status(m_playlist).permissions(), ec);
+
+    fs::rename(m_writePath, m_playlist, ec);
+    committed = !ec;
+  }
+
+  if (!committed)
+    fs::remove(m_writePath, ec);
+
+  m_writePath.clear();
+
+  return committed;
+}
 
 Playlist *playlist(const fs::path &playlist) {
   std::string extension = playlist.extension().string();
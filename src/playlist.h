@@ -18,29 +18,97 @@
 #pragma once
 
 #include <bitset>
+#include <cstdint>
+#include <ctime>
+#include <deque>
 #include <filesystem>
 #include <fstream>
+#include <functional>
+#include <initializer_list>
 #include <iostream>
+#include <memory>
+#include <mutex>
 #include <sstream>
 #include <string>
+#include <string_view>
+#include <unordered_map>
 #include <utility>
 #include <vector>
 
+#ifdef LIBCURL
+#include <curl/curl.h>
+#endif
+
 namespace fs = std::filesystem;
 
-struct Entry {
+/**
+ * Interned string, for low cardinality fields such as artist and album. Equal
+ * values share one copy in a process wide arena, so handles are pointer sized
+ * and compare by identity.
+ */
+class Interned {
+public:
+  Interned() = default;
+  Interned(std::string_view value) : m_value(intern(value)){};
+
+  Interned &operator=(std::string_view value) {
+    m_value = intern(value);
+
+    return *this;
+  };
+
+  operator std::string_view() const { return *m_value; };
+  const bool operator==(const Interned &other) const {
+    return m_value == other.m_value;
+  };
+  const bool operator!=(const Interned &other) const {
+    return m_value != other.m_value;
+  };
+
+  const char *c_str() const { return m_value->data(); };
+  const bool empty() const { return m_value->empty(); };
+  const std::string str() const { return std::string(*m_value); };
+  const std::string_view &view() const { return *m_value; };
+
+  /**
+   * Identity shared by all handles of equal value.
+   */
+  const void *id() const { return m_value; };
+
+private:
+  static const std::string_view *intern(std::string_view value);
+
+  inline static const std::string_view none = "";
+
+  const std::string_view *m_value = &none;
+};
+
+std::ostream &operator<<(std::ostream &os, const Interned &value);
+
+/**
+ * Playlist level fields of a source playlist, shared by its entries.
+ */
+struct Header {
   fs::path image;
   fs::path playlist;
-  fs::path playlistImage;
-  fs::path target;
-  std::string album;
   std::string artist;
   std::string comment;
+  std::string title;
+};
+
+typedef std::unordered_map<std::shared_ptr<const Header>,
+                           std::shared_ptr<const Header>>
+    Headers;
+
+struct Entry {
+  fs::path image;
+  fs::path target;
+  std::shared_ptr<const Header> header;
+  Interned album;
+  Interned artist;
+  std::string comment;
   std::string identifier;
   std::string info;
-  std::string playlistArtist;
-  std::string playlistComment;
-  std::string playlistTitle;
   std::string title;
   int albumTrack = 0;
   int duration = 0;
@@ -51,11 +119,54 @@ struct Entry {
   bool nestedEntry = false;
   bool validImage = false;
   bool validTarget = false;
+
+  const fs::path &playlist() const { return source().playlist; };
+  const fs::path &playlistImage() const { return source().image; };
+  const std::string &playlistArtist() const { return source().artist; };
+  const std::string &playlistComment() const { return source().comment; };
+  const std::string &playlistTitle() const { return source().title; };
+
+  /**
+   * Move entry to another playlist, keeping its other header fields.
+   *
+   * @param playlist Playlist path.
+   */
+  void setPlaylist(const fs::path &playlist);
+
+  /**
+   * Move entry to another playlist, keeping its other header fields. Entries
+   * moved from one header share the moved header, in any order.
+   *
+   * @param playlist Playlist path.
+   * @param moved Moved headers by source header, kept by the caller for the
+   * whole move.
+   */
+  void setPlaylist(const fs::path &playlist, Headers &moved);
+
+private:
+  const Header &source() const {
+    static const Header none;
+
+    return header ? *header : none;
+  };
 };
 
 typedef std::pair<const std::string, std::string> KeyValue;
 typedef std::vector<Entry> Entries;
-typedef std::bitset<35> Flags;
+typedef std::vector<std::pair<fs::path, bool *>> Targets;
+typedef std::bitset<39> Flags;
+
+enum Field {
+  FieldAlbum,
+  FieldAlbumTrack,
+  FieldArtist,
+  FieldComment,
+  FieldDuration,
+  FieldTitle,
+  FieldCount
+};
+
+typedef std::bitset<FieldCount> Fields;
 
 struct List {
   fs::path image;
@@ -79,6 +190,85 @@ struct List {
   bool validImage = false;
 };
 
+/**
+ * Text column, values stored back to back and indexed by end offset.
+ */
+class TextColumn {
+public:
+  void push_back(std::string_view value) {
+    m_data.append(value);
+    m_ends.push_back(m_data.size());
+  };
+
+  const std::string_view operator[](std::size_t i) const {
+    const std::size_t begin = i ? m_ends[i - 1] : 0;
+
+    return std::string_view(m_data).substr(begin, m_ends[i] - begin);
+  };
+
+  const std::size_t size() const { return m_ends.size(); };
+
+private:
+  std::string m_data;
+  std::vector<std::size_t> m_ends;
+};
+
+/**
+ * Column store of list entry status, duration, target and list key, for
+ * scans that would otherwise walk whole entries. Status flags are packed
+ * bitsets.
+ */
+class Columns {
+public:
+  enum Flag {
+    DuplicateTarget,
+    HasImage,
+    LocalImage,
+    LocalTarget,
+    ValidImage,
+    ValidTarget,
+    FlagCount
+  };
+
+  typedef std::vector<std::uint64_t> Bits;
+
+  /**
+   * Build the columns of entries.
+   *
+   * @param entries Entries to store.
+   * @param text Also store the target and list key text columns.
+   */
+  Columns(const Entries &entries, const bool text = false);
+
+  /**
+   * Select entries by status, as a bitset of entry indexes.
+   *
+   * @param set Flags that must be set.
+   * @param unset Flags that must be unset.
+   */
+  const Bits select(std::initializer_list<Flag> set,
+                    std::initializer_list<Flag> unset = {}) const;
+
+  /**
+   * Sum of the known entry durations.
+   */
+  const int knownDuration() const;
+
+  const std::size_t size() const { return m_size; };
+  const TextColumn &targets() const { return m_targets; };
+  const TextColumn &keys() const { return m_keys; };
+
+  static const std::size_t count(const Bits &bits);
+  static void each(const Bits &bits,
+                   const std::function<void(std::size_t)> &visit);
+
+private:
+  Bits m_flags[FlagCount];
+  std::vector<int> m_durations;
+  TextColumn m_keys, m_targets;
+  std::size_t m_size = 0;
+};
+
 class Playlist {
 public:
   Playlist(const fs::path &playlist) { m_playlist = playlist; };
@@ -91,6 +281,16 @@ public:
    */
   virtual void parse(Entries &entries) = 0;
 
+  /**
+   * Read playlist one entry at a time, without holding all entries. False
+   * if the playlist type can only be read whole, or could not be read.
+   *
+   * @param emit Called with each parsed entry.
+   */
+  virtual const bool stream(const std::function<void(Entry &)> &emit) {
+    return false;
+  };
+
   /**
    * Perform playlist type specific processing.
    *
@@ -105,9 +305,356 @@ public:
    */
   virtual const bool write(const List &list) = 0;
 
+  /**
+   * Start writing out playlist one entry at a time. False if the playlist
+   * type can only be written whole.
+   *
+   * @param list List header to write.
+   */
+  virtual const bool writeBegin(const List &list) { return false; };
+
+  /**
+   * Write out the next entry, after writeBegin().
+   *
+   * @param entry Entry to write.
+   */
+  virtual void writeEntry(const Entry &entry) {};
+
+  /**
+   * Finish writing out playlist, after writeBegin(). False on write failure.
+   */
+  virtual const bool writeEnd() { return false; };
+
+  /**
+   * Discard a playlist write started with writeBegin(), leaving any existing
+   * playlist as it was.
+   */
+  void writeAbort() { writeCommit(false); };
+
+  /**
+   * Entry metadata fields written out.
+   */
+  virtual const Fields fields() const = 0;
+
   fs::path m_playlist;
+
+protected:
+  /**
+   * Path to write the playlist to, a temporary file beside it unless the
+   * playlist is a FIFO or device that must be written in place.
+   */
+  const fs::path &writePath();
+
+  /**
+   * Move the temporary file over the playlist, or remove it if the write
+   * failed. False if the write failed or could not be committed.
+   *
+   * @param written Whether the write succeeded.
+   */
+  const bool writeCommit(const bool written);
+
+private:
+  fs::path m_writePath;
 };
 
+class MappedFile {
+public:
+  MappedFile(const fs::path &file);
+  ~MappedFile();
+
+  MappedFile(const MappedFile &) = delete;
+  MappedFile &operator=(const MappedFile &) = delete;
+
+  /**
+   * File contents, NUL terminated. Regular files are mapped copy on write, so
+   * the contents may be modified in place without touching the file.
+   */
+  char *data() { return m_data; };
+  const std::size_t size() const { return m_size; };
+
+  /**
+   * Whether the file could not be read.
+   */
+  const bool bad() const { return m_bad; };
+
+private:
+  std::vector<char> m_buffer;
+  char *m_data = nullptr;
+  std::size_t m_size = 0;
+  bool m_bad = false;
+  bool m_mapped = false;
+};
+
+class LineReader {
+public:
+  LineReader(const fs::path &file);
+  ~LineReader();
+
+  LineReader(const LineReader &) = delete;
+  LineReader &operator=(const LineReader &) = delete;
+
+  /**
+   * Read the next line, as std::getline does. The line stays valid until the
+   * next call; false at end of file, leaving it unchanged.
+   *
+   * @param line Line read, without its newline.
+   */
+  const bool getline(std::string_view &line);
+
+  const bool eof() const { return m_eof; };
+  const bool bad() const { return m_bad; };
+
+  /**
+   * Data not yet read: the rest of a regular file, or what a stream has
+   * buffered.
+   */
+  const std::string_view pending() const {
+    return std::string_view(m_pos, m_end - m_pos);
+  };
+
+private:
+  /**
+   * Read another block from a stream, keeping unread data.
+   */
+  const bool fill();
+
+  std::unique_ptr<MappedFile> m_map;
+  std::vector<char> m_buffer;
+  const char *m_end = nullptr;
+  const char *m_pos = nullptr;
+  int m_fd = -1;
+  bool m_bad = false;
+  bool m_eof = false;
+};
+
+class Index {
+public:
+  /**
+   * Check whether an added entry has the same target or track.
+   *
+   * @param entry Entry to check.
+   */
+  const bool duplicate(const Entry &entry) const;
+
+  /**
+   * Check whether no added entry from another playlist has the same target or
+   * track.
+   *
+   * @param entry Entry to check.
+   */
+  const bool unique(const Entry &entry) const;
+
+  /**
+   * Add entry, the first entry of a target or track being kept.
+   *
+   * @param entry Entry to add.
+   */
+  void insert(const Entry &entry);
+
+private:
+  struct Source {
+    fs::path playlist;
+    bool shared = false;
+  };
+
+  static const std::string targetKey(const Entry &entry);
+  static const std::string trackKey(const Entry &entry);
+
+  std::unordered_map<std::string, Source> m_targets, m_tracks;
+};
+
+class Resolver {
+public:
+  /**
+   * Resolve path symlinks and dot components, the parent directory being
+   * resolved once.
+   *
+   * @param path Path to resolve.
+   */
+  const fs::path canonical(const fs::path &path);
+
+  /**
+   * Check whether a local path exists, the parent directory being checked
+   * once.
+   *
+   * @param path Path to check.
+   */
+  const bool exists(const fs::path &path);
+
+  /**
+   * Get the modification time of the parent directory of a local path, or -1
+   * if it does not exist.
+   *
+   * @param path Path to check.
+   */
+  const time_t modified(const fs::path &path);
+
+private:
+  struct Directory {
+    fs::path canonical;
+    time_t modified = -1;
+    bool exists = false;
+  };
+
+  const Directory &directory(const fs::path &path);
+
+  std::unordered_map<std::string, Directory> m_directories;
+};
+
+class TargetCache {
+public:
+  /**
+   * Read target validation results, enabling the cache.
+   *
+   * @param file Cache file.
+   */
+  void load(const fs::path &file);
+
+  /**
+   * Write target validation results, if changed.
+   */
+  const bool save();
+
+  /**
+   * Get a fresh target validation result. Local results are fresh while the
+   * target directory is unmodified, network results for ttl seconds.
+   *
+   * @param target Target to look up.
+   * @param valid Cached validation result.
+   */
+  const bool find(const fs::path &target, bool &valid);
+
+  /**
+   * Record a target validation result.
+   *
+   * @param target Validated target.
+   * @param valid Validation result.
+   */
+  void insert(const fs::path &target, bool valid);
+
+  int ttl = 3600;
+
+private:
+  struct Record {
+    time_t checked = 0;
+    bool valid = false;
+  };
+
+  fs::path m_file;
+  std::unordered_map<std::string, Record> m_records;
+  bool m_changed = false;
+};
+
+#ifdef TAGLIB
+class MetadataCache {
+public:
+  struct Record {
+    std::string target;
+    Interned album;
+    Interned artist;
+    std::string comment;
+    std::string title;
+    std::uintmax_t size = 0;
+    time_t modified = 0;
+    int albumTrack = 0;
+    int duration = -1;
+    bool tagged = false;
+  };
+
+  /**
+   * Read target metadata, enabling the cache.
+   *
+   * @param file Cache file.
+   */
+  void load(const fs::path &file);
+
+  /**
+   * Write target metadata, if changed.
+   */
+  const bool save();
+
+  /**
+   * Get the cached metadata of a target, if its device, inode, size and
+   * modification time are unchanged.
+   *
+   * @param target Target to look up.
+   * @param record Cached metadata.
+   */
+  const bool find(const fs::path &target, Record &record);
+
+  /**
+   * Record target metadata, with every field read.
+   *
+   * @param target Read target.
+   * @param record Metadata read.
+   */
+  void insert(const fs::path &target, const Record &record);
+
+  const bool enabled() const { return !m_file.empty(); };
+
+  /**
+   * Drop the metadata of changed or missing targets.
+   */
+  void compact();
+
+private:
+  static const bool key(const fs::path &target, std::string &key,
+                        Record &record);
+
+  fs::path m_file;
+  std::unordered_map<std::string, Record> m_records;
+  std::mutex m_mutex;
+  bool m_changed = false;
+};
+#endif
+
+#ifdef LIBCURL
+class Verifier {
+public:
+  ~Verifier();
+
+  /**
+   * Queue a network target for verification.
+   *
+   * @param target Target to verify.
+   * @param valid Verification result.
+   */
+  void add(const std::string &target, bool *valid);
+
+  /**
+   * Verify queued targets, limiting requests per host, adapting timeouts to
+   * host latency, and skipping the remaining targets of unresponsive hosts.
+   * Connections, DNS, TLS sessions and host state are kept for later runs.
+   */
+  void run();
+
+private:
+  struct Host {
+    std::deque<std::string> pending;
+    double latency = 0;
+    int active = 0;
+    int failures = 0;
+    int limit = 1;
+    bool broken = false;
+    bool responded = false;
+  };
+
+  struct Target {
+    std::vector<bool *> valid;
+    Host *host = nullptr;
+  };
+
+  CURL *handle();
+
+  std::unordered_map<std::string, Host> m_hosts;
+  std::unordered_map<std::string, Target> m_targets;
+  std::vector<std::string> m_order;
+  std::vector<CURL *> m_handles;
+  CURLM *m_multi = nullptr;
+  CURLSH *m_share = nullptr;
+};
+#endif
+
 /**
  * Show playlist information.
  *
@@ -119,24 +666,80 @@ void show(const List &list);
  * List specific playlist information.
  *
  * @param list List to list.
+ * @param columns Column store of the list entries.
+ */
+void list(const List &list, const Columns &columns);
+
+/**
+ * Move entries onto the end of others, leaving the source empty.
+ *
+ * @param entries Entries to append to.
+ * @param from Entries to move.
+ */
+void spliceEntries(Entries &entries, Entries &from);
+
+/**
+ * Move an entry to another position, shifting those between by one.
+ *
+ * @param entries Entries to reorder.
+ * @param from Index of the entry to move.
+ * @param to Index to move the entry to.
  */
-void list(const List &list);
+void moveEntry(Entries &entries, std::size_t from, std::size_t to);
+
+/**
+ * Compact kept entries forward, numbering their tracks, and erase the rest.
+ *
+ * @param entries Entries to compact.
+ * @param keep Whether to keep an entry, which it may modify.
+ */
+void compactEntries(Entries &entries,
+                    const std::function<bool(Entry &)> &keep);
 #ifdef TAGLIB
-void fetchMetadata(Entry &entry);
+
+/**
+ * Fill entry metadata from the target's tags and audio properties, false if
+ * the target has no tags.
+ *
+ * @param entry Entry with a valid local target.
+ * @param fields Fields to fill; audio properties are only read for duration.
+ */
+const bool fetchMetadata(Entry &entry, const Fields &fields);
 #endif
 
+/**
+ * Fill the entry duration from the target's audio headers, falling back to
+ * TagLib for formats the header probe does not recognise. False if no
+ * duration was read.
+ *
+ * @param entry Entry with a valid local target.
+ */
+const bool fetchDuration(Entry &entry);
+
 const std::string processTarget(std::string target);
-const std::string unquote(std::string quoted);
+const std::string unquote(std::string_view str);
 const std::string percentEncode(const std::string &uri);
 const std::string percentDecode(std::string uri);
 const fs::path absPath(const fs::path &p1, const fs::path &p2);
 const KeyValue split(const std::string &line, std::string delim = "=");
+const int toInt(std::string_view str);
 const bool isUri(const std::string &target);
 const bool validTarget(const fs::path &target);
-const Entries::const_iterator find(const Entry &entry, const Entries &entries,
-                                   bool sameList = true);
+void validTargets(const Targets &targets);
+void statTargets(const Targets &targets);
+void parallel(std::size_t count, const std::function<void(std::size_t)> &task);
 Playlist *playlist(const fs::path &playlist);
 
 extern Flags flags;
-extern std::stringstream cwar;
+extern int connections;
+extern int jobs;
+extern Resolver resolver;
+extern TargetCache targetCache;
+#ifdef TAGLIB
+extern MetadataCache metadataCache;
+#endif
+#ifdef LIBCURL
+extern Verifier verifier;
+#endif
+extern thread_local std::stringstream cwar;
 extern std::string ver;
@@ -17,121 +17,219 @@
 
 #include "pls.h"
 
+#include <algorithm>
+#include <charconv>
 #include <cmath>
+#include <strings.h>
 
 #define PLS_SECTION "[playlist]"
+#define PLS_SLOT_GAP 65536
 #define PLS_VERSION 2
 
+static const bool equals(std::string_view key, std::string_view name) {
+  return (key.size() == name.size()) &&
+         !strncasecmp(key.data(), name.data(), key.size());
+}
+
+static const std::string_view trim(std::string_view str) {
+  const std::size_t begin = str.find_first_not_of(" \t");
+
+  if (begin == std::string_view::npos)
+    return std::string_view();
+
+  return str.substr(begin, str.find_last_not_of(" \t") - begin + 1);
+}
+
+/**
+ * Count lines that may be entry files.
+ */
+static const std::size_t countFiles(std::string_view data) {
+  std::size_t count = 0;
+
+  while (!data.empty()) {
+    const std::size_t end = std::min(data.find('\n'), data.size());
+
+    count += ((end > 4) && !strncasecmp(data.data(), "File", 4));
+    data.remove_prefix(std::min(end + 1, data.size()));
+  }
+
+  return count;
+}
+
 void PLS::parse(Entries &entries) {
-  std::ifstream file(m_playlist);
-  std::string line;
-  bool plsSection(false);
+  LineReader file(m_playlist);
+  const std::shared_ptr<const Header> header =
+      std::make_shared<Header>(Header{fs::path(), m_playlist});
+  std::string_view line;
+  // Entry number to position after first, plus one; zero if unseen.
+  std::vector<std::size_t> slots;
+  const std::size_t first = entries.size();
+  bool plsSection(false), sorted(true);
   int plsEntries(0), plsVersion(0);
 
-  while (line.empty())
-    std::getline(file, line);
+  auto strip = [](std::string_view &line) {
+    if (!line.empty() && (line.back() == '\r'))
+      line.remove_suffix(1);
+  };
+
+  entries.reserve(entries.size() + countFiles(file.pending()));
+
+  while (line.empty() && file.getline(line))
+    strip(line);
 
   if (line == PLS_SECTION)
     plsSection = true;
 
-  int t = 1;
-  while (!file.eof() && (plsSection || flags[31])) {
-    if (line.rfind("File" + std::to_string(t), 0) != std::string::npos) {
-      Entry entry;
+  // Keys may come in any order; each FileN, TitleN and LengthN fills slot N.
+  for (bool more = !line.empty(); more && (plsSection || flags[31]);
+       more = file.getline(line)) {
+    strip(line);
 
-      entry.target = split(line).second;
+    const std::size_t pos = line.find('=');
 
-      while ((line.rfind("File" + std::to_string(t + 1), 0) ==
-              std::string::npos) &&
-             (line.rfind("NumberOfEntries", 0) == std::string::npos) &&
-             !file.eof()) {
-        if (line.rfind("Title" + std::to_string(t), 0) != std::string::npos)
-          entry.title = split(line).second;
+    if (pos == std::string_view::npos)
+      continue;
 
-        if (line.rfind("Length" + std::to_string(t), 0) != std::string::npos)
-          entry.duration = std::stoi(split(line).second) * 1000;
+    const std::string_view key = trim(line.substr(0, pos)),
+                           value = line.substr(pos + 1);
+    const std::size_t digits = key.find_last_not_of("0123456789") + 1;
+    const std::string_view name = key.substr(0, digits);
+    std::size_t number = 0;
 
-        std::getline(file, line);
-      }
+    std::from_chars(key.data() + digits, key.data() + key.size(), number);
 
-      entry.track = t;
-      entry.playlist = m_playlist;
+    if (number && (equals(name, "File") || equals(name, "Title") ||
+                   equals(name, "Length"))) {
+      if (number > slots.size() + PLS_SLOT_GAP)
+        continue;
 
-      entries.push_back(entry);
+      if (number > slots.size())
+        slots.resize(number);
 
-      t++;
+      if (!slots[number - 1]) {
+        Entry &entry = entries.emplace_back();
 
-      continue;
-    }
+        entry.header = header;
+        entry.track = number;
 
-    if (line.rfind("NumberOfEntries", 0) != std::string::npos)
-      plsEntries = std::stoi(split(line).second);
+        sorted = sorted &&
+                 ((entries.size() - first == 1) ||
+                  (entries.at(entries.size() - 2).track < entry.track));
+        slots[number - 1] = entries.size() - first;
+      }
 
-    if (line.rfind("Version", 0) != std::string::npos)
-      plsVersion = std::stoi(split(line).second);
+      Entry &entry = entries.at(first + slots[number - 1] - 1);
 
-    std::getline(file, line);
+      if (equals(name, "File")) {
+        entry.target = value;
+      } else if (equals(name, "Title")) {
+        entry.title = value;
+      } else {
+        entry.duration = toInt(value) * 1000;
+      }
+    } else if (equals(key, "NumberOfEntries")) {
+      plsEntries = toInt(value);
+    } else if (equals(key, "Version")) {
+      plsVersion = toInt(value);
+    }
   }
 
-  file.close();
+  // Titles and lengths without a file make no entry.
+  entries.erase(std::remove_if(entries.begin() + first, entries.end(),
+                               [](const Entry &entry) {
+                                 return entry.target.empty();
+                               }),
+                entries.end());
+
+  if (!sorted)
+    std::sort(entries.begin() + first, entries.end(),
+              [](const Entry &e1, const Entry &e2) {
+                return e1.track < e2.track;
+              });
 
-  if (file.bad() || !plsSection || (plsEntries != (int)entries.size()) ||
+  // Tracks are positions, as in the other playlist types, not slot numbers.
+  for (std::size_t i = first; i < entries.size(); i++)
+    entries[i].track = i - first + 1;
+
+  const int parsed = entries.size() - first;
+
+  if (file.bad() || !plsSection || (plsEntries != parsed) ||
       (plsVersion != PLS_VERSION)) {
     cwar << "Playlist parse error(s): " << m_playlist << std::endl;
 
     if (!plsSection)
       cwar << "Section not found" << std::endl;
 
-    if (plsEntries != (int)entries.size())
+    if (plsEntries != parsed)
       cwar << "Entry count mismatch" << std::endl;
 
     if (plsVersion != PLS_VERSION)
       cwar << "Invalid or missing version" << std::endl;
 
     if (file.bad() || !flags[31])
-      entries.clear();
+      entries.erase(entries.begin() + first, entries.end());
   }
 }
 
 const bool PLS::write(const List &list) {
-  std::ofstream file(m_playlist);
+  writeBegin(list);
+
+  for (const Entry &entry : list.entries)
+    writeEntry(entry);
+
+  return writeEnd();
+}
 
-  file << PLS_SECTION << std::endl;
-  file << std::endl;
+const bool PLS::writeBegin(const List &list) {
+  m_file.open(writePath());
+  m_entries = 0;
+  m_separate = false;
 
-  for (const Entry &entry : list.entries) {
-    bool targetOnly =
-        (entry.artist.empty() && entry.title.empty() && (entry.duration == 0));
+  m_file << PLS_SECTION << std::endl;
+  m_file << std::endl;
 
-    file << "File" << entry.track << "=" << entry.target.string() << std::endl;
+  return !m_file.fail();
+}
 
-    if (!targetOnly && !flags[18]) {
-      if (!entry.artist.empty() || !entry.title.empty()) {
-        file << "Title" << entry.track << "=" << entry.artist;
+void PLS::writeEntry(const Entry &entry) {
+  bool targetOnly =
+      (entry.artist.empty() && entry.title.empty() && (entry.duration == 0));
 
-        if (!entry.artist.empty() && !entry.title.empty())
-          file << " - ";
+  // Entries with more than a target are separated from the next entry.
+  if (m_separate)
+    m_file << '\n';
 
-        file << entry.title << std::endl;
-      }
+  m_file << "File" << entry.track << "=" << entry.target.string() << '\n';
+  m_entries++;
+  m_separate = false;
 
-      if (entry.duration > 0) {
-        file << "Length" << entry.track << "="
-             << std::ceil(entry.duration / 1000.0) << std::endl;
-      } else if (!entry.localTarget) {
-        file << "Length" << entry.track << "=-1" << std::endl;
-      }
+  if (!targetOnly && !flags[18]) {
+    if (!entry.artist.empty() || !entry.title.empty()) {
+      m_file << "Title" << entry.track << "=" << entry.artist;
+
+      if (!entry.artist.empty() && !entry.title.empty())
+        m_file << " - ";
 
-      if (!targetOnly && (entry.track != (int)list.entries.size()))
-        file << std::endl;
+      m_file << entry.title << '\n';
     }
+
+    if (entry.duration > 0) {
+      m_file << "Length" << entry.track << "="
+             << std::ceil(entry.duration / 1000.0) << '\n';
+    } else if (!entry.localTarget) {
+      m_file << "Length" << entry.track << "=-1" << '\n';
+    }
+
+    m_separate = true;
   }
+}
 
-  file << std::endl;
-  file << "NumberOfEntries"
-       << "=" << list.entries.size() << std::endl;
-  file << "Version=" << PLS_VERSION << std::endl;
-  file.close();
+const bool PLS::writeEnd() {
+  m_file << std::endl;
+  m_file << "NumberOfEntries"
+         << "=" << m_entries << std::endl;
+  m_file << "Version=" << PLS_VERSION << std::endl;
+  m_file.close();
 
-  return !file.fail();
+  return writeCommit(!m_file.fail());
 }
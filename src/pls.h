@@ -26,4 +26,15 @@ public:
   void parse(Entries &entries) override;
   void writePreProcess(List &list) override {};
   const bool write(const List &list) override;
+  const bool writeBegin(const List &list) override;
+  void writeEntry(const Entry &entry) override;
+  const bool writeEnd() override;
+  const Fields fields() const override {
+    return Fields().set(FieldArtist).set(FieldDuration).set(FieldTitle);
+  };
+
+private:
+  std::ofstream m_file;
+  std::size_t m_entries = 0;
+  bool m_separate = false;
 };
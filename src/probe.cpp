@@ -0,0 +1,324 @@
+/* playlist probe module
+ * Copyright (C) 2021 - 2023 James D. Smith
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <https://www.gnu.org/licenses/>.
+ */
+
+#include "probe.h"
+
+#include <algorithm>
+#include <cstring>
+#include <limits>
+#include <vector>
+
+#define MPEG_SYNC_WINDOW 4096
+#define OGG_TAIL (65536 + 4096)
+
+static const std::uint64_t be(const char *data, int bytes) {
+  std::uint64_t value = 0;
+
+  for (int i = 0; i < bytes; i++)
+    value = (value << 8) | (unsigned char)data[i];
+
+  return value;
+}
+
+static const std::uint64_t le(const char *data, int bytes) {
+  std::uint64_t value = 0;
+
+  for (int i = bytes - 1; i >= 0; i--)
+    value = (value << 8) | (unsigned char)data[i];
+
+  return value;
+}
+
+static const int milliseconds(std::uint64_t samples, std::uint64_t rate) {
+  if (!rate || (samples / rate) > (std::numeric_limits<int>::max() / 1000))
+    return -1;
+
+  return (samples * 1000) / rate;
+}
+
+struct MpegHeader {
+  int bitrate = 0;
+  int channels = 2;
+  int length = 0;
+  int rate = 0;
+  int samples = 0;
+  int version = 0;
+};
+
+static const bool mpegHeader(const unsigned char *h, MpegHeader &header) {
+  static const int bitrates[5][15] = {
+      {0, 32, 64, 96, 128, 160, 192, 224, 256, 288, 320, 352, 384, 416, 448},
+      {0, 32, 48, 56, 64, 80, 96, 112, 128, 160, 192, 224, 256, 320, 384},
+      {0, 32, 40, 48, 56, 64, 80, 96, 112, 128, 160, 192, 224, 256, 320},
+      {0, 32, 48, 56, 64, 80, 96, 112, 128, 144, 160, 176, 192, 224, 256},
+      {0, 8, 16, 24, 32, 40, 48, 56, 64, 80, 96, 112, 128, 144, 160}};
+  static const int rates[3] = {44100, 48000, 32000};
+  const int version = (h[1] >> 3) & 3, layer = 4 - ((h[1] >> 1) & 3),
+            bitrate = h[2] >> 4, rate = (h[2] >> 2) & 3;
+
+  if ((h[0] != 0xFF) || ((h[1] & 0xE0) != 0xE0) || (version == 1) ||
+      (layer == 4) || !bitrate || (bitrate == 15) || (rate == 3))
+    return false;
+
+  // MPEG 1 = 1, MPEG 2 = 2, MPEG 2.5 = 3
+  header.version = (version == 3) ? 1 : (version == 2) ? 2 : 3;
+  header.bitrate = bitrates[(header.version == 1) ? layer - 1
+                            : (layer == 1)        ? 3
+                                                  : 4][bitrate];
+  header.rate = rates[rate] >> (header.version - 1);
+  header.channels = ((h[3] >> 6) == 3) ? 1 : 2;
+  header.samples = (layer == 1)                              ? 384
+                   : ((layer == 3) && (header.version != 1)) ? 576
+                                                             : 1152;
+
+  if (layer == 1) {
+    header.length =
+        ((12 * header.bitrate * 1000 / header.rate) + ((h[2] >> 1) & 1)) * 4;
+  } else {
+    header.length = (header.samples / 8 * header.bitrate * 1000 / header.rate) +
+                    ((h[2] >> 1) & 1);
+  }
+
+  return true;
+}
+
+Probe::Probe(const fs::path &target) {
+  std::error_code ec;
+
+  m_size = fs::file_size(target, ec);
+
+  if (!ec)
+    m_file.open(target, std::ios::binary);
+}
+
+const int Probe::duration() {
+  std::uint64_t offset = 0;
+  char data[12];
+
+  if (!m_file.is_open() || !read(0, data, sizeof(data)))
+    return -1;
+
+  if (!std::memcmp(data, "OggS", 4))
+    return ogg();
+
+  if (!std::memcmp(data + 4, "ftyp", 4))
+    return mp4();
+
+  // ID3v2 tags may precede both FLAC and MPEG audio, sometimes repeatedly.
+  while (!std::memcmp(data, "ID3", 3)) {
+    offset += 10 + ((data[5] & 0x10) ? 10 : 0) + ((data[6] & 0x7F) << 21) +
+              ((data[7] & 0x7F) << 14) + ((data[8] & 0x7F) << 7) +
+              (data[9] & 0x7F);
+
+    if (!read(offset, data, 10))
+      return -1;
+  }
+
+  if (!std::memcmp(data, "fLaC", 4))
+    return flac(offset);
+
+  return mpeg(offset);
+}
+
+const int Probe::flac(std::uint64_t offset) {
+  char data[4 + 4 + 34];
+
+  // STREAMINFO is always the first metadata block.
+  if (!read(offset, data, sizeof(data)) || ((data[4] & 0x7F) != 0))
+    return -1;
+
+  const char *info = data + 8;
+  const std::uint64_t rate = be(info + 10, 3) >> 4,
+                      samples = be(info + 13, 5) & 0xFFFFFFFFFULL;
+
+  return samples ? milliseconds(samples, rate) : -1;
+}
+
+const int Probe::mpeg(std::uint64_t offset) {
+  std::vector<char> buffer(MPEG_SYNC_WINDOW + 2048);
+  const unsigned char *data = (const unsigned char *)buffer.data();
+  std::size_t size = std::min<std::uint64_t>(
+      buffer.size(), (m_size > offset) ? m_size - offset : 0);
+  MpegHeader header, next;
+  std::size_t frame = 0;
+
+  if ((size < 4) || !read(offset, buffer.data(), size))
+    return -1;
+
+  // Accept a frame sync only when the following frame agrees with it, so
+  // that arbitrary data is not mistaken for MPEG audio.
+  for (; frame + 4 <= std::min<std::size_t>(size, MPEG_SYNC_WINDOW); frame++) {
+    if (!mpegHeader(data + frame, header))
+      continue;
+
+    if ((frame + header.length + 4 <= size) &&
+        mpegHeader(data + frame + header.length, next) &&
+        (next.version == header.version) && (next.rate == header.rate))
+      break;
+  }
+
+  if (frame + 4 > std::min<std::size_t>(size, MPEG_SYNC_WINDOW))
+    return -1;
+
+  const int side = (header.version == 1) ? ((header.channels == 1) ? 17 : 32)
+                                         : ((header.channels == 1) ? 9 : 17);
+  const char *xing = buffer.data() + frame + 4 + side;
+  const char *vbri = buffer.data() + frame + 4 + 32;
+
+  if ((xing + 8 <= buffer.data() + size) &&
+      (!std::memcmp(xing, "Xing", 4) || !std::memcmp(xing, "Info", 4))) {
+    const std::uint64_t flags = be(xing + 4, 4);
+
+    if ((flags & 1) && (xing + 12 <= buffer.data() + size)) {
+      std::uint64_t samples = be(xing + 8, 4) * header.samples;
+      const char *lame = xing + 8 + ((flags & 1) ? 4 : 0) +
+                         ((flags & 2) ? 4 : 0) + ((flags & 4) ? 100 : 0) +
+                         ((flags & 8) ? 4 : 0);
+
+      // The LAME extension records encoder delay and padding in samples.
+      if ((lame + 24 <= buffer.data() + size) &&
+          (!std::memcmp(lame, "LAME", 4) || !std::memcmp(lame, "Lavf", 4) ||
+           !std::memcmp(lame, "Lavc", 4))) {
+        const std::uint64_t gap = be(lame + 21, 3),
+                            trim = (gap >> 12) + (gap & 0xFFF);
+
+        if (trim < samples)
+          samples -= trim;
+      }
+
+      return milliseconds(samples, header.rate);
+    }
+  } else if ((vbri + 18 <= buffer.data() + size) &&
+             !std::memcmp(vbri, "VBRI", 4)) {
+    return milliseconds(be(vbri + 14, 4) * header.samples, header.rate);
+  }
+
+  // Constant bitrate: the audio runs to the end of the file or an ID3v1 tag.
+  std::uint64_t end = m_size;
+  char tag[3];
+
+  if ((m_size >= 128) && read(m_size - 128, tag, sizeof(tag)) &&
+      !std::memcmp(tag, "TAG", 3))
+    end -= 128;
+
+  if (end <= offset + frame)
+    return -1;
+
+  return milliseconds((end - offset - frame) * 8, header.bitrate * 1000);
+}
+
+const int Probe::mp4() {
+  std::uint64_t offset = 0, end = m_size;
+  char box[16];
+
+  // Walk the top level boxes to moov, then its children to mvhd.
+  while (offset + 8 <= end && read(offset, box, 8)) {
+    std::uint64_t size = be(box, 4), header = 8;
+
+    if (size == 1) {
+      if (!read(offset + 8, box + 8, 8))
+        return -1;
+
+      size = be(box + 8, 8);
+      header = 16;
+    } else if (size == 0) {
+      size = end - offset;
+    }
+
+    if ((size < header) || (offset + size > m_size))
+      return -1;
+
+    if (!std::memcmp(box + 4, "moov", 4)) {
+      end = offset + size;
+      offset += header;
+    } else if (!std::memcmp(box + 4, "mvhd", 4)) {
+      char mvhd[32];
+
+      if (!read(offset + header, mvhd, sizeof(mvhd)))
+        return -1;
+
+      if (mvhd[0] == 1)
+        return milliseconds(be(mvhd + 24, 8), be(mvhd + 20, 4));
+
+      return milliseconds(be(mvhd + 16, 4), be(mvhd + 12, 4));
+    } else {
+      offset += size;
+    }
+  }
+
+  return -1;
+}
+
+const int Probe::ogg() {
+  char page[27 + 255 + 64];
+  std::uint64_t rate = 0, skip = 0;
+
+  if (!read(0, page, 27) || !read(27, page + 27, (unsigned char)page[26]))
+    return -1;
+
+  const std::uint64_t serial = le(page + 14, 4);
+  const char *packet = page + 27 + (unsigned char)page[26];
+
+  if (!read(packet - page, (char *)packet, 64))
+    return -1;
+
+  if (!std::memcmp(packet, "\x01vorbis", 7)) {
+    rate = le(packet + 12, 4);
+  } else if (!std::memcmp(packet, "OpusHead", 8)) {
+    rate = 48000;
+    skip = le(packet + 10, 2);
+  } else if (!std::memcmp(packet, "\x7F" "FLAC", 5)) {
+    rate = be(packet + 27, 3) >> 4;
+  } else if (!std::memcmp(packet, "Speex   ", 8)) {
+    rate = le(packet + 36, 4);
+  } else {
+    return -1;
+  }
+
+  // An Ogg page is at most 65307 bytes, so the tail holds the final page.
+  const std::uint64_t size = std::min<std::uint64_t>(m_size, OGG_TAIL);
+  std::vector<char> tail(size);
+
+  if (!read(m_size - size, tail.data(), size))
+    return -1;
+
+  for (std::size_t i = size - std::min<std::size_t>(size, 27) + 1; i-- > 0;) {
+    if (std::memcmp(tail.data() + i, "OggS", 4) ||
+        (le(tail.data() + i + 14, 4) != serial))
+      continue;
+
+    const std::uint64_t granule = le(tail.data() + i + 6, 8);
+
+    if (granule == ~0ULL)
+      continue;
+
+    return (granule > skip) ? milliseconds(granule - skip, rate) : -1;
+  }
+
+  return -1;
+}
+
+const bool Probe::read(std::uint64_t offset, char *data, std::size_t size) {
+  if (offset + size > m_size)
+    return false;
+
+  m_file.clear();
+  m_file.seekg(offset);
+  m_file.read(data, size);
+
+  return (std::size_t(m_file.gcount()) == size);
+}
@@ -0,0 +1,54 @@
+/* playlist probe module
+ * Copyright (C) 2021 - 2023 James D. Smith
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <https://www.gnu.org/licenses/>.
+ */
+
+#pragma once
+
+#include <cstdint>
+#include <filesystem>
+#include <fstream>
+
+namespace fs = std::filesystem;
+
+class Probe {
+public:
+  Probe(const fs::path &target);
+
+  /**
+   * Read the target duration in milliseconds from its container headers, or
+   * -1 if the format is not recognised or the headers carry no duration.
+   * FLAC, MPEG audio, Ogg (Vorbis, Opus, FLAC, Speex) and MP4 are recognised.
+   */
+  const int duration();
+
+private:
+  const int flac(std::uint64_t offset);
+  const int mpeg(std::uint64_t offset);
+  const int mp4();
+  const int ogg();
+
+  /**
+   * Read target bytes, false if not all could be read.
+   *
+   * @param offset Offset to read from.
+   * @param data Buffer to read into.
+   * @param size Bytes to read.
+   */
+  const bool read(std::uint64_t offset, char *data, std::size_t size);
+
+  std::ifstream m_file;
+  std::uint64_t m_size = 0;
+};
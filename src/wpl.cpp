@@ -18,6 +18,7 @@
 #include "wpl.h"
 
 #include <cmath>
+#include <iterator>
 
 #include <pugixml.hpp>
 
@@ -27,15 +28,13 @@
 using namespace pugi;
 
 void WPL::parse(Entries &entries) {
+  MappedFile file(m_playlist);
   pugi::xml_document playlist;
-  std::ifstream file(m_playlist);
-  pugi::xml_parse_result result(
-      playlist.load(file, pugi::parse_default | pugi::parse_pi));
+  pugi::xml_parse_result result(playlist.load_buffer_inplace(
+      file.data(), file.size(), pugi::parse_default | pugi::parse_pi));
   pugi::xml_node head, seq;
   std::string comment, creator, image, title;
 
-  file.close();
-
   if (result && !file.bad() && playlist.child(WPL_PI)) {
     head = playlist.child(WPL_ROOT).child("head");
     seq = playlist.child(WPL_ROOT).child("body").child("seq");
@@ -50,19 +49,21 @@ void WPL::parse(Entries &entries) {
         image = meta.attribute("content").as_string();
     }
 
+    const std::shared_ptr<const Header> header = std::make_shared<Header>(
+        Header{image, m_playlist, creator, comment, title});
+
+    const auto medias = seq.children("media");
     int t = 1;
-    for (const pugi::xml_node &media : seq.children("media")) {
-      Entry entry;
+
+    entries.reserve(entries.size() +
+                    std::distance(medias.begin(), medias.end()));
+
+    for (const pugi::xml_node &media : medias) {
+      Entry &entry = entries.emplace_back();
 
       entry.target = media.attribute("src").as_string();
       entry.track = t;
-      entry.playlist = m_playlist;
-      entry.playlistArtist = creator;
-      entry.playlistComment = comment;
-      entry.playlistImage = image;
-      entry.playlistTitle = title;
-
-      entries.push_back(entry);
+      entry.header = header;
 
       t++;
     }
@@ -17,23 +17,74 @@
 
 #include "xspf.h"
 
+#include <algorithm>
+#include <bitset>
+#include <cerrno>
+#include <cstring>
 #include <iterator>
 
+#include <fcntl.h>
 #include <pugixml.hpp>
+#include <unistd.h>
 
+#define XSPF_BLOCK (1 << 20)
 #define XSPF_ROOT "playlist"
 
 using namespace pugi;
 
+/**
+ * Read entry fields from a track node. The first child of each name is used,
+ * as child() would find it.
+ */
+static void readTrack(const pugi::xml_node &track, Entry &entry) {
+  std::bitset<10> seen;
+
+  for (pugi::xml_node node = track.first_child(); node;
+       node = node.next_sibling()) {
+    const char *name = node.name();
+
+    if (!seen[0] && !std::strcmp(name, "album")) {
+      entry.album = node.text().as_string();
+      seen[0] = true;
+    } else if (!seen[1] && !std::strcmp(name, "annotation")) {
+      entry.comment = node.text().as_string();
+      seen[1] = true;
+    } else if (!seen[2] && !std::strcmp(name, "creator")) {
+      entry.artist = node.text().as_string();
+      seen[2] = true;
+    } else if (!seen[3] && !std::strcmp(name, "duration")) {
+      entry.duration = node.text().as_int();
+      seen[3] = true;
+    } else if (!seen[4] && !std::strcmp(name, "identifier")) {
+      entry.identifier = node.text().as_string();
+      seen[4] = true;
+    } else if (!seen[5] && !std::strcmp(name, "image")) {
+      entry.image = node.text().as_string();
+      seen[5] = true;
+    } else if (!seen[6] && !std::strcmp(name, "info")) {
+      entry.info = node.text().as_string();
+      seen[6] = true;
+    } else if (!seen[7] && !std::strcmp(name, "location")) {
+      entry.target = node.text().as_string();
+      seen[7] = true;
+    } else if (!seen[8] && !std::strcmp(name, "title")) {
+      entry.title = node.text().as_string();
+      seen[8] = true;
+    } else if (!seen[9] && !std::strcmp(name, "trackNum")) {
+      entry.albumTrack = node.text().as_int();
+      seen[9] = true;
+    }
+  }
+}
+
 void XSPF::parse(Entries &entries) {
+  MappedFile file(m_playlist);
   pugi::xml_document playlist;
-  std::ifstream file(m_playlist);
-  pugi::xml_parse_result result(playlist.load(file));
+  pugi::xml_parse_result result(
+      playlist.load_buffer_inplace(file.data(), file.size()));
   pugi::xml_node trackList;
   std::string comment, creator, image, title;
 
-  file.close();
-
   if (result && !file.bad() && playlist.child(XSPF_ROOT)) {
     trackList = playlist.child(XSPF_ROOT).child("trackList");
     comment = playlist.child(XSPF_ROOT).child("annotation").text().as_string();
@@ -41,28 +92,29 @@ void XSPF::parse(Entries &entries) {
     image = playlist.child(XSPF_ROOT).child("image").text().as_string();
     title = playlist.child(XSPF_ROOT).child("title").text().as_string();
 
-    for (const pugi::xml_node &track : trackList.children("track")) {
-      Entry entry;
-
-      entry.album = track.child("album").text().as_string();
-      entry.comment = track.child("annotation").text().as_string();
-      entry.artist = track.child("creator").text().as_string();
-      entry.duration = track.child("duration").text().as_int();
-      entry.identifier = track.child("identifier").text().as_string();
-      entry.image = track.child("image").text().as_string();
-      entry.info = track.child("info").text().as_string();
-      entry.target = track.child("location").text().as_string();
-      entry.title = track.child("title").text().as_string();
-      entry.albumTrack = track.child("trackNum").text().as_int();
-      entry.track =
-          std::distance<pugi::xml_node::iterator>(trackList.begin(), track) + 1;
-      entry.playlist = m_playlist;
-      entry.playlistArtist = creator;
-      entry.playlistComment = comment;
-      entry.playlistImage = image;
-      entry.playlistTitle = title;
-
-      entries.push_back(entry);
+    const std::shared_ptr<const Header> header = std::make_shared<Header>(
+        Header{image, m_playlist, creator, comment, title});
+
+    const auto tracks = trackList.children("track");
+    int t = 0;
+
+    entries.reserve(entries.size() +
+                    std::distance(tracks.begin(), tracks.end()));
+
+    for (pugi::xml_node track = trackList.first_child(); track;
+         track = track.next_sibling()) {
+      // Tracks are numbered by their position among all trackList children.
+      t++;
+
+      if (std::strcmp(track.name(), "track"))
+        continue;
+
+      Entry &entry = entries.emplace_back();
+
+      readTrack(track, entry);
+
+      entry.track = t;
+      entry.header = header;
     }
   } else {
     cwar << "Playlist parse error(s): " << m_playlist << std::endl;
@@ -75,6 +127,208 @@ void XSPF::parse(Entries &entries) {
   }
 }
 
+const bool XSPF::stream(const std::function<void(Entry &)> &emit) {
+  const int fd = open(m_playlist.c_str(), O_RDONLY);
+  std::shared_ptr<Header> header = std::make_shared<Header>();
+  std::string buffer, error;
+  std::size_t pos = 0, track = std::string::npos;
+  int depth = 0, t = 0;
+  bool body = false, eof = false, text = false;
+
+  if (fd < 0)
+    return false;
+
+  // Read another block, dropping what is no longer needed: everything before
+  // the open track, once the header before the trackList has been read.
+  const auto more = [&]() {
+    const std::size_t keep = !body ? 0 : std::min(track, pos);
+    const std::size_t size = buffer.size() - keep;
+    ssize_t bytes;
+
+    if (eof)
+      return false;
+
+    buffer.erase(0, keep);
+    buffer.resize(size + XSPF_BLOCK);
+    pos -= keep;
+
+    if (track != std::string::npos)
+      track -= keep;
+
+    while (((bytes = read(fd, buffer.data() + size, XSPF_BLOCK)) < 0) &&
+           (errno == EINTR))
+      ;
+
+    buffer.resize(size + std::max<ssize_t>(bytes, 0));
+    eof = (bytes <= 0);
+
+    return !eof;
+  };
+
+  // Find the end of the markup at lt, or npos if it is not all read yet.
+  const auto markup = [&](std::size_t lt) {
+    const std::string_view tag = std::string_view(buffer).substr(lt);
+    const auto after = [&](std::size_t from, std::string_view close) {
+      const std::size_t i = tag.find(close, from);
+
+      return (i == std::string::npos) ? i : lt + i + close.size();
+    };
+    std::size_t brackets = 0;
+    char quote = 0;
+
+    if ((tag.size() < 9) && !eof)
+      return std::string::npos;
+
+    if (!tag.compare(0, 4, "<!--"))
+      return after(4, "-->");
+
+    if (!tag.compare(0, 9, "<![CDATA["))
+      return after(9, "]]>");
+
+    if (!tag.compare(0, 2, "<?"))
+      return after(2, "?>");
+
+    for (std::size_t i = 1; i < tag.size(); i++) {
+      if (quote) {
+        quote = (tag[i] == quote) ? 0 : quote;
+      } else if ((tag[i] == '"') || (tag[i] == '\'')) {
+        quote = tag[i];
+      } else if (tag[i] == '[') {
+        brackets++;
+      } else if ((tag[i] == ']') && brackets) {
+        brackets--;
+      } else if ((tag[i] == '>') && !brackets) {
+        return lt + i + 1;
+      }
+    }
+
+    return std::string::npos;
+  };
+
+  // Parse the track from its start tag to end, in place.
+  const auto emitTrack = [&](std::size_t end) {
+    pugi::xml_document fragment;
+    pugi::xml_parse_result result(
+        fragment.load_buffer_inplace(buffer.data() + track, end - track));
+    Entry entry;
+
+    track = std::string::npos;
+
+    if (!result) {
+      error = result.description();
+
+      return;
+    }
+
+    readTrack(fragment.first_child(), entry);
+
+    entry.track = t;
+    entry.header = header;
+
+    emit(entry);
+  };
+
+  while (error.empty()) {
+    const std::size_t lt = buffer.find('<', pos);
+    const std::size_t end =
+        (lt == std::string::npos) ? std::string::npos : markup(lt);
+
+    // Text directly in the trackList is a child, and numbered as one.
+    if (body && (depth == 2) && !text &&
+        (std::string_view(buffer)
+             .substr(pos, std::min(lt, buffer.size()) - pos)
+             .find_first_not_of(" \t\r\n") != std::string::npos)) {
+      text = true;
+      t++;
+    }
+
+    if (end == std::string::npos) {
+      pos = std::min(lt, buffer.size());
+
+      if (more())
+        continue;
+
+      if (depth || !body)
+        error = "Unexpected end of document";
+
+      break;
+    }
+
+    const std::string_view tag(buffer.data() + lt, end - lt);
+    const std::string_view name =
+        tag.substr(1, tag.find_first_of(" \t\r\n/>", 1) - 1);
+    const bool empty = (tag[tag.size() - 2] == '/');
+
+    pos = end;
+    text = false;
+
+    if ((tag[1] == '!') || (tag[1] == '?')) {
+      if (body && (depth == 2) && !tag.compare(0, 9, "<![CDATA["))
+        t++;
+    } else if (tag[1] == '/') {
+      if (--depth < 0) {
+        error = "Start-end tags mismatch";
+      } else if (body && (depth == 2) && (track != std::string::npos)) {
+        emitTrack(end);
+      } else if (body && (depth == 1)) {
+        break;
+      }
+    } else if (!depth && (name != XSPF_ROOT)) {
+      error = "Unrecognized root node";
+    } else if (!body && (depth == 1) && (name == "trackList")) {
+      // The header is everything before the trackList, closed off.
+      pugi::xml_document playlist;
+      pugi::xml_parse_result result(playlist.load_string(
+          (buffer.substr(0, lt) + "</" XSPF_ROOT ">").c_str()));
+
+      if (!result) {
+        error = result.description();
+
+        break;
+      }
+
+      header->artist =
+          playlist.child(XSPF_ROOT).child("creator").text().as_string();
+      header->comment =
+          playlist.child(XSPF_ROOT).child("annotation").text().as_string();
+      header->image =
+          playlist.child(XSPF_ROOT).child("image").text().as_string();
+      header->playlist = m_playlist;
+      header->title =
+          playlist.child(XSPF_ROOT).child("title").text().as_string();
+      body = true;
+
+      if (empty)
+        break;
+
+      depth++;
+    } else {
+      if (body && (depth == 2)) {
+        // Tracks are numbered by their position among all trackList children.
+        t++;
+
+        if (name == "track")
+          track = lt;
+      }
+
+      if (!empty) {
+        depth++;
+      } else if (track == lt) {
+        emitTrack(end);
+      }
+    }
+  }
+
+  close(fd);
+
+  if (!error.empty()) {
+    cwar << "Playlist parse error(s): " << m_playlist << std::endl;
+    cwar << error << std::endl;
+  }
+
+  return error.empty();
+}
+
 const bool XSPF::write(const List &list) {
   pugi::xml_node doc, playList, track, trackList;
   pugi::xml_document pl;
@@ -24,6 +24,8 @@ public:
   XSPF(const fs::path &playlist) : Playlist(playlist) {};
 
   void parse(Entries &entries) override;
+  const bool stream(const std::function<void(Entry &)> &emit) override;
   void writePreProcess(List &list) override {};
   const bool write(const List &list) override;
+  const Fields fields() const override { return Fields().set(); };
 };